@@ -0,0 +1,242 @@
+/**********************************************************
+
+Benchmark of the main operations of the simulation.
+
+The mesh is loaded from position.txt and neighbors.txt in the working
+directory. Options are given as key=value:
+	threads: number of threads (0 for all hardware threads)
+	reps: number of timed repetitions of each operation
+	warmup: number of untimed repetitions before the timed ones
+	minimization_reps: number of timed repetitions of the full minimization
+	tip_x: x coordinate (m) of the filament tip
+	json: file name of the JSON output
+Other options are passed to MS::set_option().
+
+**********************************************************/
+
+#include<algorithm>
+#include<chrono>
+#include<cmath>
+#include<cstdlib>
+#include<functional>
+#include<iomanip>
+#include<vector>
+
+#include"common.h"
+#include"mesh_initialization.h"
+#include"parallel.h"
+#include"simulation_process.h"
+#include"surface_mesh.h"
+#include"surface_mesh_tip.h"
+
+#ifndef BENCHMARK_REVISION
+#  define BENCHMARK_REVISION "unknown"
+#endif
+
+struct benchmark_result {
+	std::string name;
+	std::vector<double> seconds;
+
+	double median, mad, min, max, mean; // mad is the median absolute deviation
+
+	void calc_statistics() {
+		std::vector<double> sorted = seconds;
+		std::sort(sorted.begin(), sorted.end());
+		median = median_of(sorted);
+		min = sorted.front();
+		max = sorted.back();
+		mean = 0;
+		for (double each_time : sorted) mean += each_time;
+		mean /= sorted.size();
+
+		std::vector<double> deviations;
+		for (double each_time : sorted) deviations.push_back(std::abs(each_time - median));
+		std::sort(deviations.begin(), deviations.end());
+		mad = median_of(deviations);
+	}
+
+private:
+	static double median_of(const std::vector<double>& sorted) {
+		size_t n = sorted.size();
+		return (n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2);
+	}
+};
+
+// Runs setup (untimed) and then op (timed) warmup + reps times.
+benchmark_result run_benchmark(const std::string &name, int warmup, int reps, const std::function<void()> &setup, const std::function<void()> &op) {
+	benchmark_result res;
+	res.name = name;
+	for (int i = 0; i < warmup + reps; i++) {
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		op();
+		double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (i >= warmup) res.seconds.push_back(t);
+	}
+	res.calc_statistics();
+	std::cout << std::left << std::setw(28) << name << std::right
+		<< " median " << std::setw(12) << res.median * 1e3 << " ms"
+		<< "  mad " << std::setw(10) << res.mad * 1e3 << " ms"
+		<< "  min " << std::setw(12) << res.min * 1e3 << " ms"
+		<< "  max " << std::setw(12) << res.max * 1e3 << " ms"
+		<< "  (" << reps << " reps)" << std::endl;
+	return res;
+}
+
+int main(int argc, char **argv) {
+	logger::Logger::default_init("benchmark.log");
+	logger::Logger::set_screen_levels(logger::Warning | logger::Error | logger::TestError);
+
+	int num_threads = 0;
+	int reps = 21, warmup = 3, minimization_reps = 3;
+	double tip_x = 0.995e-6;
+	std::string json_file = "benchmark.json";
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq), value = (eq == std::string::npos ? "" : arg.substr(eq + 1));
+		if (key == "threads") num_threads = atoi(value.c_str());
+		else if (key == "reps") reps = std::max(1, atoi(value.c_str()));
+		else if (key == "warmup") warmup = std::max(0, atoi(value.c_str()));
+		else if (key == "minimization_reps") minimization_reps = std::max(1, atoi(value.c_str()));
+		else if (key == "tip_x") tip_x = atof(value.c_str());
+		else if (key == "json") json_file = value;
+		else if (!MS::set_option(key, value)) LOG(WARNING) << "Unknown option: " << arg;
+	}
+	parallel::set_num_threads(num_threads);
+
+	MS::surface_mesh sm;
+	if (!mesh_init(sm)) {
+		LOG(ERROR) << "Cannot load the mesh from position.txt and neighbors.txt.";
+		return 1;
+	}
+	sm.initialize();
+	int N = sm.vertices.size();
+
+	std::vector<MS::filament_tip*> tips;
+	tips.push_back(new MS::filament_tip(new math_public::Vec3(tip_x, 0, 0)));
+	for (auto each_tip : tips) {
+		each_tip->cutoff = MS::settings.repulsion_cutoff;
+		each_tip->skin = MS::settings.repulsion_skin;
+		each_tip->far_ratio = MS::settings.repulsion_far_ratio;
+		each_tip->point_ratio = MS::settings.repulsion_point_ratio;
+	}
+
+	// Every operation starts from the loaded mesh
+	const std::vector<double> x_initial = sm.state.x;
+	auto restore = [&] {
+		std::copy(x_initial.begin(), x_initial.end(), sm.state.x.begin());
+	};
+	auto update_all = [&] {
+		sm.update_geo();
+		sm.update_energy();
+		for (auto each_tip : tips) each_tip->calc_repulsion(sm);
+	};
+
+	std::cout << "Vertices: " << N << " Facets: " << sm.facets.size() << " Threads: " << parallel::get_num_threads() << std::endl;
+
+	std::vector<benchmark_result> results;
+	results.push_back(run_benchmark("surface_mesh::update_geo", warmup, reps, restore, [&] {
+		sm.update_geo();
+	}));
+	// Both cotangent kernels, whichever is selected for the other operations
+	const MS::CotangentKernel selected_kernel = MS::facet::cot_kernel;
+	MS::facet::cot_kernel = MS::TrigCotangent;
+	results.push_back(run_benchmark("update_geo (trig cotangent)", warmup, reps, restore, [&] {
+		sm.update_geo();
+	}));
+	MS::facet::cot_kernel = MS::CrossCotangent;
+	results.push_back(run_benchmark("update_geo (cross cotangent)", warmup, reps, restore, [&] {
+		sm.update_geo();
+	}));
+	MS::facet::cot_kernel = selected_kernel;
+
+	results.push_back(run_benchmark("surface_mesh::update_energy", warmup, reps, [&] {
+		restore();
+		sm.update_geo();
+	}, [&] {
+		sm.update_energy();
+	}));
+	results.push_back(run_benchmark("filament_tip::calc_repulsion", warmup, reps, [&] {
+		restore();
+		sm.update_geo();
+		sm.update_energy();
+	}, [&] {
+		for (auto each_tip : tips) each_tip->calc_repulsion(sm);
+	}));
+	// Every repulsion kernel supported by the CPU, whichever is selected for the other operations
+	const MS::RepulsionKernel selected_repulsion_kernel = MS::filament_tip::kernel;
+	const MS::RepulsionKernel repulsion_kernels[3] = { MS::RepulsionScalar, MS::RepulsionAVX2, MS::RepulsionAVX512 };
+	for (auto each_kernel : repulsion_kernels) {
+		if (!MS::repulsion_kernel_supported(each_kernel)) continue;
+		MS::filament_tip::kernel = each_kernel;
+		results.push_back(run_benchmark(std::string("calc_repulsion (") + MS::repulsion_kernel_name(each_kernel) + ")", warmup, reps, [&] {
+			restore();
+			sm.update_geo();
+			sm.update_energy();
+		}, [&] {
+			for (auto each_tip : tips) each_tip->calc_repulsion(sm);
+		}));
+	}
+	MS::filament_tip::kernel = selected_repulsion_kernel;
+
+	// Moving a single vertex, and updating only what depends on it
+	results.push_back(run_benchmark("surface_mesh::update_local", warmup, reps, [&] {
+		restore();
+		sm.update_geo();
+		sm.update_energy();
+	}, [&] {
+		*(sm.vertices[N / 2]->point) += math_public::Vec3(1e-9, -1e-9, 1e-9);
+		sm.mark_moved(N / 2);
+		sm.update_local();
+	}));
+
+	// One line search along the steepest descent direction, as in the first iteration of minimization()
+	std::vector<double> p(3 * N);
+	double H, H_new, m, m_new, d_H_max, alpha0;
+	results.push_back(run_benchmark("line_search", warmup, reps, [&] {
+		restore();
+		update_all();
+		const double *d_H = sm.state.d_H.data();
+		H = sm.get_sum_of_energy();
+		for (auto each_tip : tips) H += each_tip->H;
+		m = 0;
+		d_H_max = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			p[i] = -d_H[i];
+			m += p[i] * d_H[i];
+			d_H_max = std::max(d_H_max, std::abs(d_H[i]));
+		}
+		alpha0 = max_move / d_H_max;
+		sm.state.make_last();
+	}, [&] {
+		line_search(sm, tips, H, H_new, p.data(), d_H_max, sm.state.d_H.data(), m, m_new, alpha0);
+	}));
+
+	results.push_back(run_benchmark("minimization", 0, minimization_reps, restore, [&] {
+		minimization(sm, tips);
+	}));
+
+	std::ofstream json_out(json_file);
+	json_out << std::setprecision(9);
+	json_out << "{" << std::endl
+		<< "  \"revision\": \"" << BENCHMARK_REVISION << "\"," << std::endl
+		<< "  \"threads\": " << parallel::get_num_threads() << "," << std::endl
+		<< "  \"num_vertices\": " << N << "," << std::endl
+		<< "  \"num_facets\": " << sm.facets.size() << "," << std::endl
+		<< "  \"tip_x\": " << tip_x << "," << std::endl
+		<< "  \"benchmarks\": [" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+		const benchmark_result &r = results[i];
+		json_out << "    {\"name\": \"" << r.name << "\", \"reps\": " << r.seconds.size()
+			<< ", \"median_s\": " << r.median << ", \"mad_s\": " << r.mad
+			<< ", \"min_s\": " << r.min << ", \"max_s\": " << r.max << ", \"mean_s\": " << r.mean
+			<< ", \"samples_s\": [";
+		for (size_t j = 0; j < r.seconds.size(); j++) json_out << (j ? ", " : "") << r.seconds[j];
+		json_out << "]}" << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	json_out << "  ]" << std::endl << "}" << std::endl;
+	std::cout << "Results written to " << json_file << std::endl;
+
+	return 0;
+}
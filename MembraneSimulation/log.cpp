@@ -109,7 +109,11 @@ std::string Logger::time_gen() {
 
 	std::time_t time_to_sec = s.count();
 	tm timeinfo_to_sec;
+#ifdef _WIN32
 	localtime_s(&timeinfo_to_sec, &time_to_sec);
+#else
+	localtime_r(&time_to_sec, &timeinfo_to_sec);
+#endif
 	std::size_t ms_remain = ms.count() % 1000;
 
 	std::stringstream ss;
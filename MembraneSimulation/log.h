@@ -74,6 +74,8 @@ namespace logger {
 	public:
 		
 		static void default_init(const char* file_name);
+		// Sets the levels shown on the screen, e.g. Warning | Error
+		static void set_screen_levels(int levels) { scn_lv[On_lv] = levels; }
 
 		static void build_writer(Writer &writer, Level level);
 	private:
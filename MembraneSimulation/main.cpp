@@ -2,15 +2,50 @@
 
 #include"common.h"
 #include"mesh_initialization.h"
+#include"parallel.h"
 #include"surface_mesh.h"
 #include"surface_mesh_tip.h"
 #include"simulation_process.h"
 #include"test.h"
 
-int main() {
+int main(int argc, char **argv) {
 	logger::Logger::default_init("simulation.log");
 
-	test::run_all_tests();
+	// Options are given as key=value
+	//     threads: number of threads used by the mesh updates (0 for all hardware threads)
+	//     minimizer: sd, cg, pcg, lbfgs, fire or newton
+	//     pcg_refresh: number of iterations between the rebuilds of the pcg preconditioner
+	//     line_search: wolfe or backtracking
+	//     parallel_line_search: number of trial alphas evaluated at the same time on copies of the mesh (0 to disable)
+	//     lbfgs_history: number of correction pairs kept by L-BFGS
+	//     newton_max_inner: maximum number of Hessian-vector products of each Newton-CG step
+	//     fire_max_steps: maximum number of steps of FIRE
+	//     repulsion_cutoff: cutoff distance (m) of the tip repulsion (0 to evaluate all facets)
+	//     repulsion_skin: skin distance (m) of the neighbor facet list used with cutoff
+	//     repulsion_far_ratio: facets farther than this many times their size use a quadrature of the repulsion (0 to disable)
+	//     repulsion_point_ratio: facets farther than this many times their size use the centroid only (0 to disable)
+	//     cotangent: trig or cross, how the cotangents of the facet angles are computed
+	//     repulsion_kernel: auto, scalar, avx2 or avx512, how the tip repulsion is evaluated (auto for the best supported)
+	//     trajectory_precision: float64 or float32, the precision of the .SimTraj output
+	//     output_every: write only every k-th iteration or tip step to the trajectories
+	//     output_buffers: number of frames of each trajectory buffered for the writer threads
+	//     output_when_full: drop or wait, whether a frame is dropped (the default, counted in the log) or waits for a free buffer when all are full
+	//     mode: test to only run the tests, and return non-zero if any test fails
+	int num_threads = 0;
+	std::string mode;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq), value = (eq == std::string::npos ? "" : arg.substr(eq + 1));
+		if (key == "threads") num_threads = atoi(value.c_str());
+		else if (key == "mode") mode = value;
+		else if (!MS::set_option(key, value)) LOG(WARNING) << "Unknown option: " << arg;
+	}
+	parallel::set_num_threads(num_threads);
+	LOG(INFO) << "Number of threads: " << parallel::get_num_threads();
+
+	bool tests_passed = test::run_all_tests();
+	if (mode == "test") return (tests_passed ? 0 : 1);
 
 	MS::surface_mesh sm;
 	std::vector<MS::filament_tip*> tips;
@@ -24,7 +59,9 @@ int main() {
 	}
 
 
+#ifdef _WIN32
 	system("pause");
+#endif
 
 	return 0;
 }
\ No newline at end of file
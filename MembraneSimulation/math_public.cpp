@@ -25,17 +25,6 @@ test::TestCase math_public::test_case_arithmetics("Math arithmetics", []() {
 	}
 });
 
-Mat3 math_public::Vec3::tensor(const Vec3& operand)const {
-	Mat3 ans(operator*(operand.x), operator*(operand.y), operator*(operand.z));
-	return ans;
-}
-Mat3 math_public::Vec3::to_skew_cross()const {
-	return Mat3(
-		0, -z, y,
-		z, 0, -x,
-		-y, x, 0
-	);
-}
 std::string math_public::Vec3::str(int mode)const {
 	std::stringstream ss;
 	switch (mode) {
@@ -55,7 +44,7 @@ test::TestCase math_public::Vec3::test_case("Vec3", []() {
 		Vec3 op(3, 4, 12);
 		double ex = 13;
 		test_case.assert_bool(equal(op.get_norm(), ex));
-		test_case.assert_bool(equal(op.norm, ex));
+		test_case.assert_bool(equal(op.get_norm2(), ex * ex));
 	}
 	{
 		test_case.new_step("Check plus");
@@ -86,16 +75,16 @@ test::TestCase math_public::Vec3::test_case("Vec3", []() {
 		Vec3 ex7(1, 2, 3); double ex8 = sqrt(14);
 		op1 += op2;
 		test_case.assert_bool(op1.equal_to(ex1));
-		test_case.assert_bool(equal(op1.norm, ex2));
+		test_case.assert_bool(equal(op1.get_norm(), ex2));
 		op1 -= op2;
 		test_case.assert_bool(op1.equal_to(ex3));
-		test_case.assert_bool(equal(op1.norm, ex4));
+		test_case.assert_bool(equal(op1.get_norm(), ex4));
 		op1 *= op3;
 		test_case.assert_bool(op1.equal_to(ex5));
-		test_case.assert_bool(equal(op1.norm, ex6));
+		test_case.assert_bool(equal(op1.get_norm(), ex6));
 		op1 /= op3;
 		test_case.assert_bool(op1.equal_to(ex7));
-		test_case.assert_bool(equal(op1.norm, ex8));
+		test_case.assert_bool(equal(op1.get_norm(), ex8));
 	}
 	{
 		test_case.new_step("Check dot product");
@@ -169,4 +158,12 @@ test::TestCase math_public::Mat3::test_case("Mat3", []() {
 		Mat3 ex(30, 24, 18, 84, 69, 54, 138, 114, 90);
 		test_case.assert_bool((op1*op2).equal_to(ex));
 	}
+	{
+		test_case.new_step("Check transpose and constant expressions");
+		constexpr Mat3 op1(1, 2, 3, 4, 5, 6, 7, 8, 9);
+		constexpr Mat3 op1_t = op1.transpose();
+		static_assert((op1 * Vec3(1, 0, 0)).y == 4, "Matrix multiplication is incorrect in a constant expression.");
+		Mat3 ex(1, 4, 7, 2, 5, 8, 3, 6, 9);
+		test_case.assert_bool(op1_t.equal_to(ex));
+	}
 });
\ No newline at end of file
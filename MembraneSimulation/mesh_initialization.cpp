@@ -9,18 +9,17 @@ Loading an already defined mesh file into the data structure.
 
 #include"common.h"
 #include"math_public.h"
+#include"mesh_initialization.h"
 #include"surface_mesh.h"
 #include"simulation_process.h"
 
 bool mesh_init(MS::surface_mesh &sm) {
 	auto &vertices = sm.vertices;
-	auto &facets = sm.facets;
-	auto &edges = sm.edges;
 
 	bool success = false;
 
-	char *position_file = "position.txt";
-	char *neighbors_file = "neighbors.txt";
+	const char *position_file = "position.txt";
+	const char *neighbors_file = "neighbors.txt";
 
 	struct stat buffer;
 	if (stat(position_file, &buffer) == 0 && stat(neighbors_file, &buffer) == 0) { // File exists
@@ -33,7 +32,7 @@ bool mesh_init(MS::surface_mesh &sm) {
 
 		std::string line;
 
-		int num_vertices, num_edges, num_facets;
+		int num_vertices, num_edges;
 
 		// getting positions
 		while (std::getline(position_in, line)) {
@@ -54,7 +53,6 @@ bool mesh_init(MS::surface_mesh &sm) {
 			int n;
 			while (ss >> n) {
 				vertices[num_vertices]->n.push_back(vertices[n]);
-				vertices[num_vertices]->dump_data_vectors();
 				num_edges++;
 			}
 			vertices[num_vertices]->gen_next_prev_n();
@@ -63,55 +61,8 @@ bool mesh_init(MS::surface_mesh &sm) {
 		num_edges /= 2;
 
 		LOG(INFO) << "Number of vertices: " << num_vertices << "; Number of edges: " << num_edges;
-		int predicted_num_facets = num_edges - num_vertices + 2; // Euler characteristic is 2
-
-		LOG(INFO) << "Registering edges and facets...";
-		facets.reserve(predicted_num_facets);
-		edges.reserve(num_edges);
-		num_facets = 0;
-		for (int i = 0; i < num_vertices; i++) {
-			vertices[i]->f.resize(vertices[i]->neighbors, 0);
-			vertices[i]->e.resize(vertices[i]->neighbors, 0);
-		}
-		for (int i = 0; i < num_vertices; i++) {
-			for (int j = 0; j < vertices[i]->neighbors; j++) {
-				if (!vertices[i]->f[j]) { // facet not registered
-					// Propose a facet
-					MS::facet *f = new MS::facet(vertices[i], vertices[i]->n[j], vertices[i]->nn[j]);
-					// should have j == f->ind[0]
-					if (true && j != f->ind[0])LOG(ERROR) << "Facet inconsistent: i=" << i << ", j=" << j;
-					vertices[i]->f[j] = f;
-					vertices[i]->n[j]->f[f->ind[1]] = f;
-					vertices[i]->nn[j]->f[f->ind[2]] = f;
-					facets.push_back(f);
-					num_facets++;
-				}
-				if (!vertices[i]->e[j]) { // edge not registered
-					// Propose an edge
-					MS::edge *e = new MS::edge(vertices[i], vertices[i]->n[j]);
-					// should have j == e->ind[0]
-					if (true && j != e->ind[0])LOG(ERROR) << "Edge inconsistent: i=" << i << ", j=" << j;
-					vertices[i]->e[j] = e;
-					vertices[i]->n[j]->e[e->ind[1]] = e;
-					edges.push_back(e);
-				}
-
-			}
-		}
-		LOG(DEBUG) << "Predicted number of facets: " << predicted_num_facets << "; Number of facets: " << num_facets;
-		if (predicted_num_facets != num_facets)
-			LOG(WARNING) << "The number of facets (" << num_facets << ") is not as expected (" << predicted_num_facets << ").";
-
-		// Facets-edges interplay
-		for (int i = 0; i < num_facets; i++) {
-			for (int j = 0; j < 3; j++)
-				facets[i]->e[j] = facets[i]->v[j]->e[facets[i]->ind[j]];
-		}
-		for (int i = 0; i < num_edges; i++) {
-			for (int j = 0; j < 2; j++)
-				edges[i]->f[j] = edges[i]->v[j]->f[edges[i]->ind[j]];
-		}
 
+		mesh_build(sm);
 
 		position_in.close();
 		neighbors_in.close();
@@ -124,4 +75,98 @@ bool mesh_init(MS::surface_mesh &sm) {
 	}
 
 	return success;
-}
\ No newline at end of file
+}
+
+void mesh_build(MS::surface_mesh &sm) {
+	auto &vertices = sm.vertices;
+	auto &facets = sm.facets;
+	auto &edges = sm.edges;
+
+	int num_vertices = vertices.size(), num_edges = 0, num_facets;
+	for (int i = 0; i < num_vertices; i++) num_edges += vertices[i]->n.size();
+	num_edges /= 2;
+
+	// Building the half-edge topology and allocating contiguous geometry storage and state for all vertices
+	sm.topo.build(vertices);
+	sm.geo_store.bind(vertices, sm.topo);
+	sm.state.bind(vertices);
+
+	int predicted_num_facets = num_edges - num_vertices + 2; // Euler characteristic is 2
+
+	LOG(INFO) << "Registering edges and facets...";
+	facets.reserve(predicted_num_facets);
+	edges.reserve(num_edges);
+	num_facets = 0;
+	for (int i = 0; i < num_vertices; i++) {
+		vertices[i]->f.resize(vertices[i]->neighbors, 0);
+		vertices[i]->e.resize(vertices[i]->neighbors, 0);
+	}
+	for (int i = 0; i < num_vertices; i++) {
+		for (int j = 0; j < vertices[i]->neighbors; j++) {
+			if (!vertices[i]->f[j]) { // facet not registered
+				// Propose a facet
+				MS::facet *f = new MS::facet(vertices[i], vertices[i]->n[j], vertices[i]->nn[j]);
+				// should have j == f->ind[0]
+				if (true && j != f->ind[0])LOG(ERROR) << "Facet inconsistent: i=" << i << ", j=" << j;
+				vertices[i]->f[j] = f;
+				vertices[i]->n[j]->f[f->ind[1]] = f;
+				vertices[i]->nn[j]->f[f->ind[2]] = f;
+				facets.push_back(f);
+				num_facets++;
+			}
+			if (!vertices[i]->e[j]) { // edge not registered
+				// Propose an edge
+				MS::edge *e = new MS::edge(vertices[i], vertices[i]->n[j]);
+				// should have j == e->ind[0]
+				if (true && j != e->ind[0])LOG(ERROR) << "Edge inconsistent: i=" << i << ", j=" << j;
+				vertices[i]->e[j] = e;
+				vertices[i]->n[j]->e[e->ind[1]] = e;
+				edges.push_back(e);
+			}
+
+		}
+	}
+	LOG(DEBUG) << "Predicted number of facets: " << predicted_num_facets << "; Number of facets: " << num_facets;
+	if (predicted_num_facets != num_facets)
+		LOG(WARNING) << "The number of facets (" << num_facets << ") is not as expected (" << predicted_num_facets << ").";
+
+	// Facets-edges interplay
+	for (int i = 0; i < num_facets; i++) {
+		for (int j = 0; j < 3; j++)
+			facets[i]->e[j] = facets[i]->v[j]->e[facets[i]->ind[j]];
+	}
+	for (int i = 0; i < num_edges; i++) {
+		for (int j = 0; j < 2; j++)
+			edges[i]->f[j] = edges[i]->v[j]->f[edges[i]->ind[j]];
+	}
+
+	// Vertices-facets interplay
+	sm.topo.build_incidence(facets);
+}
+
+void mesh_copy(const MS::surface_mesh &src, MS::surface_mesh &dst) {
+	auto &vertices = dst.vertices;
+	int num_vertices = src.vertices.size();
+
+	for (int i = 0; i < num_vertices; i++) {
+		const MS::vertex *v = src.vertices[i];
+		MS::vertex *new_vertex = new MS::vertex(new math_public::Vec3(*(v->point)));
+		*(new_vertex->point_last) = *(v->point_last);
+		vertices.push_back(new_vertex);
+	}
+	for (int i = 0; i < num_vertices; i++) {
+		for (auto each_n : src.vertices[i]->n) {
+			vertices[i]->n.push_back(vertices[each_n->index]);
+		}
+		vertices[i]->gen_next_prev_n();
+	}
+
+	mesh_build(dst);
+	dst.initialize();
+
+	// The initial geometry is not where src is now
+	for (int i = 0; i < num_vertices; i++) {
+		vertices[i]->area0 = src.vertices[i]->area0;
+	}
+	dst.osm_p = src.osm_p;
+}
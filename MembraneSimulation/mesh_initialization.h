@@ -2,4 +2,12 @@
 
 #include"surface_mesh.h"
 
-bool mesh_init(MS::surface_mesh &sm);
\ No newline at end of file
+bool mesh_init(MS::surface_mesh &sm);
+
+// Builds the topology, the storage, the facets and the edges of a closed mesh,
+// whose vertices and their neighbors in counter-clockwise order are given.
+void mesh_build(MS::surface_mesh &sm);
+
+// Builds dst as an independent copy of src, with the same vertex order, positions, initial
+// areas and osmotic pressure. dst must be empty, and src must have been built and initialized.
+void mesh_copy(const MS::surface_mesh &src, MS::surface_mesh &dst);
@@ -0,0 +1,167 @@
+#include"parallel.h"
+
+#include<new>
+
+using namespace parallel;
+
+thread_local bool thread_pool::in_loop = false;
+
+thread_pool& thread_pool::instance() {
+	static thread_pool pool;
+	return pool;
+}
+
+thread_pool::thread_pool() {
+	allocate_ranges(1);
+}
+thread_pool::~thread_pool() {
+	stop_workers();
+	free_ranges();
+}
+
+void thread_pool::allocate_ranges(int n) {
+	const size_t align = alignof(range);
+	ranges_buffer = new char[n * sizeof(range) + align];
+	size_t offset = (align - reinterpret_cast<size_t>(ranges_buffer) % align) % align;
+	ranges = reinterpret_cast<range*>(ranges_buffer + offset);
+	for (int i = 0; i < n; i++) new (ranges + i) range();
+	num_ranges = n;
+}
+void thread_pool::free_ranges() {
+	for (int i = 0; i < num_ranges; i++) ranges[i].~range();
+	delete[] ranges_buffer;
+	ranges = nullptr;
+	ranges_buffer = nullptr;
+	num_ranges = 0;
+}
+
+void thread_pool::set_num_threads(int n) {
+	if (n <= 0) n = std::thread::hardware_concurrency();
+	if (n <= 0) n = 1;
+	if (n == num_threads) return;
+
+	stop_workers();
+
+	num_threads = n;
+	free_ranges();
+	allocate_ranges(n);
+	stop = false;
+	for (int i = 1; i < n; i++) {
+		workers.emplace_back(&thread_pool::worker_main, this, i);
+	}
+}
+
+void thread_pool::stop_workers() {
+	{
+		std::lock_guard<std::mutex> lk(m);
+		stop = true;
+	}
+	cv_start.notify_all();
+	for (auto& each_worker : workers) each_worker.join();
+	workers.clear();
+}
+
+void thread_pool::run(int begin, int end, int grain, void(*func)(void*, int, int), void *ctx) {
+	// Split the range evenly
+	int len = end - begin;
+	for (int i = 0; i < num_threads; i++) {
+		std::lock_guard<std::mutex> lk(ranges[i].m);
+		ranges[i].begin = begin + (int)((long long)len * i / num_threads);
+		ranges[i].end = begin + (int)((long long)len * (i + 1) / num_threads);
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(m);
+		job_func = func;
+		job_ctx = ctx;
+		job_grain = grain;
+		active_workers = num_threads - 1;
+		++generation;
+	}
+	cv_start.notify_all();
+
+	// The calling thread works as worker 0
+	in_loop = true;
+	work(0);
+	in_loop = false;
+
+	// Every worker must have left the loop before the job could be replaced.
+	std::unique_lock<std::mutex> lk(m);
+	cv_done.wait(lk, [this] { return active_workers == 0; });
+}
+
+void thread_pool::worker_main(int id) {
+	unsigned long long seen = 0;
+	in_loop = true;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lk(m);
+			cv_start.wait(lk, [this, seen] { return stop || generation != seen; });
+			if (stop) return;
+			seen = generation;
+		}
+
+		work(id);
+
+		{
+			std::lock_guard<std::mutex> lk(m);
+			--active_workers;
+		}
+		cv_done.notify_one();
+	}
+}
+
+void thread_pool::work(int id) {
+	int b, e;
+	while (true) {
+		while (take(id, b, e)) {
+			job_func(job_ctx, b, e);
+		}
+		if (!steal(id)) return;
+	}
+}
+
+bool thread_pool::take(int id, int &b, int &e) {
+	range &r = ranges[id];
+	std::lock_guard<std::mutex> lk(r.m);
+	if (r.begin >= r.end) return false;
+	b = r.begin;
+	e = (r.end - r.begin > job_grain ? r.begin + job_grain : r.end);
+	r.begin = e;
+	return true;
+}
+
+bool thread_pool::steal(int id) {
+	// Find the victim with the most remaining work
+	int victim = -1, most = 0;
+	for (int i = 0; i < num_threads; i++) {
+		if (i == id) continue;
+		range &r = ranges[i];
+		std::lock_guard<std::mutex> lk(r.m);
+		if (r.end - r.begin > most) {
+			most = r.end - r.begin;
+			victim = i;
+		}
+	}
+	if (victim < 0) return false;
+
+	// Take the back half (at least one chunk) from the victim
+	int b, e;
+	{
+		range &r = ranges[victim];
+		std::lock_guard<std::mutex> lk(r.m);
+		int remaining = r.end - r.begin;
+		if (remaining <= 0) return true; // Someone was faster. Look again.
+		int amount = (remaining > 2 * job_grain ? remaining / 2 : (remaining < job_grain ? remaining : job_grain));
+		e = r.end;
+		b = r.end - amount;
+		r.end = b;
+	}
+	{
+		range &r = ranges[id];
+		std::lock_guard<std::mutex> lk(r.m);
+		r.begin = b;
+		r.end = e;
+	}
+	return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+/**********************************************************
+
+A small work-stealing thread pool for loops over mesh elements.
+
+**********************************************************/
+
+#include<condition_variable>
+#include<mutex>
+#include<thread>
+#include<type_traits>
+#include<vector>
+
+namespace parallel {
+
+	class thread_pool {
+		/**********************************************************************
+		The calling thread and (num_threads - 1) background workers share one
+		loop at a time. The index range is first split evenly among all
+		threads. Each thread takes chunks of "grain" indices from the front of
+		its own range, and when its range is empty, it steals the back half of
+		the largest remaining range of another thread.
+
+		Iterations must be independent of each other. The result of every
+		iteration does not depend on which thread runs it, so a loop gives
+		identical results for any number of threads.
+
+		A loop started from inside another loop runs serially on the calling
+		thread. No memory is allocated when running a loop.
+		**********************************************************************/
+	public:
+		static thread_pool& instance();
+
+		~thread_pool();
+
+		// n <= 0 uses all hardware threads.
+		void set_num_threads(int n);
+		inline int get_num_threads()const { return num_threads; }
+
+		template<typename Func>
+		void parallel_for(int begin, int end, Func&& func, int grain = 32) {
+			if (end <= begin) return;
+			if (num_threads == 1 || in_loop || end - begin <= grain) {
+				for (int i = begin; i < end; i++) func(i);
+				return;
+			}
+			run(begin, end, grain, &call_range<typename std::remove_reference<Func>::type>, &func);
+		}
+
+	private:
+		thread_pool();
+
+		struct alignas(64) range {
+			std::mutex m;
+			int begin = 0, end = 0;
+		};
+
+		int num_threads = 1;
+		std::vector<std::thread> workers;
+		// One range per thread. Plain new does not honor alignas(64) before C++17, so the
+		// ranges are constructed in a buffer aligned by hand, each on its own cache line.
+		range *ranges = nullptr;
+		char *ranges_buffer = nullptr;
+		int num_ranges = 0;
+		void allocate_ranges(int n);
+		void free_ranges();
+
+		// Current loop
+		void(*job_func)(void*, int, int) = nullptr;
+		void *job_ctx = nullptr;
+		int job_grain = 1;
+
+		std::mutex m;
+		std::condition_variable cv_start, cv_done;
+		unsigned long long generation = 0;
+		int active_workers = 0;
+		bool stop = false;
+
+		static thread_local bool in_loop;
+
+		template<typename Func>
+		static void call_range(void *ctx, int b, int e) {
+			Func &func = *static_cast<Func*>(ctx);
+			for (int i = b; i < e; i++) func(i);
+		}
+
+		void run(int begin, int end, int grain, void(*func)(void*, int, int), void *ctx);
+		void work(int id); // Process chunks until no work can be found
+		bool take(int id, int &b, int &e);
+		bool steal(int id);
+		void worker_main(int id);
+		void stop_workers();
+	};
+
+	inline void set_num_threads(int n) { thread_pool::instance().set_num_threads(n); }
+	inline int get_num_threads() { return thread_pool::instance().get_num_threads(); }
+
+	template<typename Func>
+	inline void parallel_for(int begin, int end, Func&& func, int grain = 32) {
+		thread_pool::instance().parallel_for(begin, end, func, grain);
+	}
+
+}
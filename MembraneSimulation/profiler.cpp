@@ -0,0 +1,117 @@
+#include<iomanip>
+#include<mutex>
+#include<vector>
+
+#include"common.h"
+#include"profiler.h"
+
+namespace profiler {
+
+	struct phase_totals {
+		double seconds[max_phases];
+		long long calls[max_phases];
+		void clear() {
+			for (int i = 0; i < max_phases; i++) {
+				seconds[i] = 0;
+				calls[i] = 0;
+			}
+		}
+		void add(const phase_totals& operand) {
+			for (int i = 0; i < max_phases; i++) {
+				seconds[i] += operand.seconds[i];
+				calls[i] += operand.calls[i];
+			}
+		}
+	};
+	struct thread_record : phase_totals {
+		thread_record();
+		~thread_record();
+	};
+
+	struct registry {
+		std::mutex m;
+		int num_phases = 0;
+		std::string names[max_phases];
+		std::vector<thread_record*> records; // Records of running threads
+		phase_totals retired; // Sum of records of threads that have exited
+		registry() { retired.clear(); }
+	};
+	// Never destroyed, because threads of the pool might exit after static objects are destroyed.
+	static registry& get_registry() {
+		static registry *r = new registry();
+		return *r;
+	}
+
+	thread_record::thread_record() {
+		clear();
+		registry &r = get_registry();
+		std::lock_guard<std::mutex> lk(r.m);
+		r.records.push_back(this);
+	}
+	thread_record::~thread_record() {
+		registry &r = get_registry();
+		std::lock_guard<std::mutex> lk(r.m);
+		r.retired.add(*this);
+		for (size_t i = 0; i < r.records.size(); i++) {
+			if (r.records[i] == this) {
+				r.records.erase(r.records.begin() + i);
+				break;
+			}
+		}
+	}
+
+	static thread_local thread_record record;
+
+	int register_phase(const char* name) {
+		registry &r = get_registry();
+		std::lock_guard<std::mutex> lk(r.m);
+		for (int i = 0; i < r.num_phases; i++) {
+			if (r.names[i] == name) return i;
+		}
+		if (r.num_phases == max_phases) {
+			LOG(WARNING) << "Too many profiler phases. Phase " << name << " is merged into " << r.names[max_phases - 1];
+			return max_phases - 1;
+		}
+		r.names[r.num_phases] = name;
+		return r.num_phases++;
+	}
+
+	void add(int id, double seconds) {
+		record.seconds[id] += seconds;
+		record.calls[id]++;
+	}
+
+	void reset() {
+		registry &r = get_registry();
+		std::lock_guard<std::mutex> lk(r.m);
+		for (auto each_record : r.records) each_record->clear();
+		r.retired.clear();
+	}
+
+	void report(const std::string& title, const char* reference_phase, const char* file_name) {
+		registry &r = get_registry();
+		std::lock_guard<std::mutex> lk(r.m);
+
+		phase_totals sum = r.retired;
+		for (auto each_record : r.records) sum.add(*each_record);
+		double reference = 0;
+		for (int i = 0; i < r.num_phases; i++) {
+			if (r.names[i] == reference_phase) reference = sum.seconds[i];
+		}
+
+		std::stringstream ss;
+		std::ofstream file_out(file_name, std::ios::app);
+		ss << std::left << std::setw(44) << "Phase" << std::right << std::setw(12) << "Calls" << std::setw(14) << "Total (s)" << std::setw(14) << "Mean (us)" << std::setw(10) << "%" << std::endl;
+		ss << std::fixed;
+		for (int i = 0; i < r.num_phases; i++) {
+			if (sum.calls[i] == 0) continue;
+			double mean_us = sum.seconds[i] / sum.calls[i] * 1e6;
+			double percentage = (reference > 0 ? sum.seconds[i] / reference * 100 : 0);
+			ss << std::left << std::setw(44) << r.names[i] << std::right << std::setw(12) << sum.calls[i]
+				<< std::setw(14) << std::setprecision(4) << sum.seconds[i] << std::setw(14) << std::setprecision(2) << mean_us << std::setw(10) << std::setprecision(1) << percentage << std::endl;
+			file_out << title << '\t' << r.names[i] << '\t' << sum.calls[i] << '\t' << sum.seconds[i] << '\t' << mean_us << '\t' << percentage << std::endl;
+		}
+		LOG(INFO) << "Profile of " << title << " (times of nested phases are inclusive, and summed over threads):" << std::endl << ss.str();
+	}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/**********************************************************
+
+Scoped timers for finding out where the time goes.
+
+Usage:
+	void f() {
+		PROFILE_SCOPE("f");
+		...
+	}
+
+USE_PROFILER sets which timers are compiled:
+	0: None.
+	1: Phases of the minimization, each covering a whole mesh.
+	2: Also the functions called for every vertex or facet. Each timer
+	   reads the clock twice, which might cost as much as the function
+	   itself on some platforms.
+
+**********************************************************/
+
+#include<chrono>
+#include<string>
+
+#ifndef USE_PROFILER
+#  define USE_PROFILER 1
+#endif
+
+namespace profiler {
+
+	const int max_phases = 64;
+
+	// Returns the id of a phase with the name, registering it if it is new.
+	int register_phase(const char* name);
+
+	// Adds the time of one call of the phase to the record of the calling thread.
+	void add(int id, double seconds);
+
+	class scoped_timer {
+		/**********************************************************************
+		Measures the time from construction to destruction.
+
+		Every thread accumulates into its own record, so that timers in
+		parallel loops do not contend for any lock. Times of nested phases are
+		inclusive, and times of phases run in parallel loops are summed over
+		all threads.
+		**********************************************************************/
+	public:
+		explicit scoped_timer(int n_id) :id(n_id), start(std::chrono::steady_clock::now()) {}
+		~scoped_timer() {
+			add(id, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		scoped_timer(const scoped_timer&) = delete;
+	private:
+		int id;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// Clears the records of all threads. No timer should be running.
+	void reset();
+
+	// Writes the records since the last reset() to the logger, and appends
+	// them to a tab-separated file with columns
+	//     title, phase, calls, total seconds, mean microseconds, percentage of the reference phase
+	// No timer should be running.
+	void report(const std::string& title, const char* reference_phase, const char* file_name);
+
+}
+
+#define PROFILER_CONCAT_IMPL(A, B) A##B
+#define PROFILER_CONCAT(A, B) PROFILER_CONCAT_IMPL(A, B)
+
+#define PROFILE_SCOPE_IMPL(NAME) \
+	static const int PROFILER_CONCAT(profile_id_, __LINE__) = profiler::register_phase(NAME); \
+	profiler::scoped_timer PROFILER_CONCAT(profile_timer_, __LINE__)(PROFILER_CONCAT(profile_id_, __LINE__))
+
+#if USE_PROFILER >= 1
+#  define PROFILE_SCOPE(NAME) PROFILE_SCOPE_IMPL(NAME)
+#else
+#  define PROFILE_SCOPE(NAME)
+#endif
+#if USE_PROFILER >= 2
+#  define PROFILE_SCOPE_DETAIL(NAME) PROFILE_SCOPE_IMPL(NAME)
+#else
+#  define PROFILE_SCOPE_DETAIL(NAME)
+#endif
@@ -1,13 +1,20 @@
 #define _USE_MATH_DEFINES
 
+#include<algorithm>
+#include<chrono>
+#include<limits>
+
 #include"simulation_process.h"
 
 #include"common.h"
 #include"math_public.h"
+#include"mesh_initialization.h"
+#include"parallel.h"
+#include"profiler.h"
 #include"surface_mesh.h"
 #include"surface_mesh_tip.h"
+#include"trajectory.h"
 
-#define USE_STEEPEST_DESCENT false
 #define USE_LINE_SEARCH true
 
 
@@ -15,9 +22,18 @@
 	0: Normal simulation
 	1: Derivative test
 	2: Direction force profile of one vertex
+	3: Thread scaling of geometry and energy updates
 */
 #define RUN_MODE 0
 
+// FIRE
+const int fire_n_min = 5; // Number of steps with positive power before the time step could grow
+const double fire_f_inc = 1.1; // Growth of the time step
+const double fire_f_dec = 0.5; // Shrink of the time step when the power is not positive
+const double fire_alpha_start = 0.1; // Initial mixing of the velocity towards the force
+const double fire_f_alpha = 0.99; // Decay of the mixing
+const double fire_dt_max_factor = 10; // Maximum time step relative to the initial one
+
 // Wolfe conditions
 // Armijo Rule
 const double c1 = 0.0001; // Inequality relaxation
@@ -27,15 +43,351 @@ const double c2 = 0.1;
 
 const double h_eps = 1e-12; // Maximum tolerance for forces
 const double d_eps = 1e-8; // Maximum tolerance for coordinates
-const double max_move = 5e-8; // Maximum displacement for each step in any direction
 
 
-int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips);
+MS::simulation_settings MS::settings;
+
+bool MS::set_option(const std::string &key, const std::string &value) {
+	if (key == "minimizer") {
+		if (value == "sd") settings.minimizer = SteepestDescent;
+		else if (value == "cg") settings.minimizer = ConjugateGradient;
+		else if (value == "lbfgs") settings.minimizer = LBFGS;
+		else if (value == "fire") settings.minimizer = FIRE;
+		else if (value == "newton") settings.minimizer = NewtonCG;
+		else if (value == "pcg") settings.minimizer = PreconditionedCG;
+		else {
+			LOG(WARNING) << "Unknown minimizer: " << value;
+		}
+		return true;
+	}
+	if (key == "line_search") {
+		if (value == "wolfe") settings.line_search = WolfeLineSearch;
+		else if (value == "backtracking") settings.line_search = BacktrackingLineSearch;
+		else {
+			LOG(WARNING) << "Unknown line search: " << value;
+		}
+		return true;
+	}
+	if (key == "lbfgs_history") {
+		settings.lbfgs_history = atoi(value.c_str());
+		if (settings.lbfgs_history < 1) settings.lbfgs_history = 1;
+		return true;
+	}
+	if (key == "pcg_refresh") {
+		settings.pcg_refresh = atoi(value.c_str());
+		if (settings.pcg_refresh < 1) settings.pcg_refresh = 1;
+		return true;
+	}
+	if (key == "newton_max_inner") {
+		settings.newton_max_inner = atoi(value.c_str());
+		if (settings.newton_max_inner < 1) settings.newton_max_inner = 1;
+		return true;
+	}
+	if (key == "fire_max_steps") {
+		settings.fire_max_steps = atoi(value.c_str());
+		if (settings.fire_max_steps < 1) settings.fire_max_steps = 1;
+		return true;
+	}
+	if (key == "parallel_line_search") {
+		settings.parallel_line_search = atoi(value.c_str());
+		return true;
+	}
+	if (key == "repulsion_cutoff") {
+		settings.repulsion_cutoff = atof(value.c_str());
+		return true;
+	}
+	if (key == "repulsion_skin") {
+		settings.repulsion_skin = atof(value.c_str());
+		return true;
+	}
+	if (key == "repulsion_far_ratio") {
+		settings.repulsion_far_ratio = atof(value.c_str());
+		return true;
+	}
+	if (key == "repulsion_point_ratio") {
+		settings.repulsion_point_ratio = atof(value.c_str());
+		return true;
+	}
+	if (key == "output_every") {
+		settings.output_every = atoi(value.c_str());
+		if (settings.output_every < 1) settings.output_every = 1;
+		return true;
+	}
+	if (key == "output_buffers") {
+		settings.output_buffers = atoi(value.c_str());
+		if (settings.output_buffers < 1) settings.output_buffers = 1;
+		return true;
+	}
+	if (key == "output_when_full") {
+		if (value == "wait") settings.output_drop_when_full = false;
+		else if (value == "drop") settings.output_drop_when_full = true;
+		else {
+			LOG(WARNING) << "Unknown output_when_full: " << value;
+		}
+		return true;
+	}
+	if (key == "cotangent") {
+		if (value == "trig") facet::cot_kernel = TrigCotangent;
+		else if (value == "cross") facet::cot_kernel = CrossCotangent;
+		else {
+			LOG(WARNING) << "Unknown cotangent kernel: " << value;
+		}
+		return true;
+	}
+	if (key == "repulsion_kernel") {
+		RepulsionKernel kernel;
+		if (value == "auto") kernel = best_repulsion_kernel();
+		else if (value == "scalar") kernel = RepulsionScalar;
+		else if (value == "avx2") kernel = RepulsionAVX2;
+		else if (value == "avx512") kernel = RepulsionAVX512;
+		else {
+			LOG(WARNING) << "Unknown repulsion kernel: " << value;
+			return true;
+		}
+		if (!repulsion_kernel_supported(kernel)) {
+			LOG(WARNING) << "Repulsion kernel " << value << " is not supported, using " << repulsion_kernel_name(best_repulsion_kernel());
+			kernel = best_repulsion_kernel();
+		}
+		filament_tip::kernel = kernel;
+		return true;
+	}
+	if (key == "trajectory_precision") {
+		if (value == "float64") settings.trajectory_single_precision = false;
+		else if (value == "float32") settings.trajectory_single_precision = true;
+		else {
+			LOG(WARNING) << "Unknown trajectory precision: " << value;
+		}
+		return true;
+	}
+	return false;
+}
+
+class lbfgs_memory {
+	/**************************************************************************
+		Keeps the most recent pairs of
+			s = x_new - x_old, and y = d_H_new - d_H_old
+		in a ring buffer, and applies the L-BFGS approximation of the inverse
+		Hessian to a gradient using the two-loop recursion.
+	**************************************************************************/
+public:
+	lbfgs_memory(int history, int size) :m(history), n(size), count(0), newest(-1),
+		s(history * size), y(history * size), rho(history), a(history) {}
+
+	inline int size()const { return count; }
+	inline void clear() { count = 0; newest = -1; }
+
+	// The move was alpha * p. Returns false if the pair is rejected because
+	// it does not satisfy the curvature condition s * y > 0.
+	bool push(double alpha, const double *p, const double *d_H_old, const double *d_H_new) {
+		// The slot might hold the oldest pair, which must be kept if this pair is rejected.
+		double sy = 0;
+		for (int i = 0; i < n; i++) {
+			sy += (alpha * p[i]) * (d_H_new[i] - d_H_old[i]);
+		}
+		if (!(sy > 0)) return false;
+		int slot = (newest + 1) % m;
+		double *s_k = &s[slot * n], *y_k = &y[slot * n];
+		for (int i = 0; i < n; i++) {
+			s_k[i] = alpha * p[i];
+			y_k[i] = d_H_new[i] - d_H_old[i];
+		}
+		rho[slot] = 1 / sy;
+		newest = slot;
+		if (count < m) count++;
+		return true;
+	}
+
+	// p = -H_k * d_H
+	void direction(const double *d_H, double *p) {
+		for (int i = 0; i < n; i++) p[i] = d_H[i];
+		for (int j = 0; j < count; j++) { // From the newest to the oldest
+			int slot = (newest - j + m) % m;
+			const double *s_k = &s[slot * n], *y_k = &y[slot * n];
+			double sq = 0;
+			for (int i = 0; i < n; i++) sq += s_k[i] * p[i];
+			a[slot] = rho[slot] * sq;
+			for (int i = 0; i < n; i++) p[i] -= a[slot] * y_k[i];
+		}
+		if (count > 0) { // Scaling of the initial Hessian
+			const double *y_k = &y[newest * n];
+			double yy = 0;
+			for (int i = 0; i < n; i++) yy += y_k[i] * y_k[i];
+			double gamma0 = 1 / (rho[newest] * yy);
+			for (int i = 0; i < n; i++) p[i] *= gamma0;
+		}
+		for (int j = count - 1; j >= 0; j--) { // From the oldest to the newest
+			int slot = (newest - j + m) % m;
+			const double *s_k = &s[slot * n], *y_k = &y[slot * n];
+			double yr = 0;
+			for (int i = 0; i < n; i++) yr += y_k[i] * p[i];
+			double b = rho[slot] * yr;
+			for (int i = 0; i < n; i++) p[i] += (a[slot] - b) * s_k[i];
+		}
+		for (int i = 0; i < n; i++) p[i] = -p[i];
+	}
+
+private:
+	int m, n; // History depth and number of variables
+	int count, newest;
+	std::vector<double> s, y, rho, a;
+};
+
+class block_jacobi_preconditioner {
+	/**************************************************************************
+		Approximates the inverse Hessian by the inverses of the 3x3 diagonal
+		blocks of each vertex, from vertex::calc_H_block(). Each block gets
+		a small multiple of its trace added on the diagonal, so that it is
+		positive definite even where the Gauss-Newton terms are degenerate.
+	**************************************************************************/
+public:
+	block_jacobi_preconditioner(int num_vertices) :n(num_vertices), inv(num_vertices) {}
+
+	// Builds the blocks from the current geometry of the mesh
+	void update(MS::surface_mesh &sm) {
+		PROFILE_SCOPE("block_jacobi_preconditioner::update");
+		using namespace math_public;
+		parallel::parallel_for(0, n, [this, &sm](int i) {
+			Mat3 block = sm.vertices[i]->calc_H_block();
+			double shift = 1e-3 * (block.x.x + block.y.y + block.z.z) / 3;
+			block += shift * Eye3;
+			// The inverse of a symmetric matrix from the cross products of its columns
+			Vec3 yz = cross(block.y, block.z), zx = cross(block.z, block.x), xy = cross(block.x, block.y);
+			double det = dot(block.x, yz);
+			inv[i] = (det > 0 ? Mat3(yz, zx, xy) / det : Mat3());
+		});
+		// A block which is not positive definite uses the average of the others
+		double inv_trace = 0;
+		int num_valid = 0;
+		for (int i = 0; i < n; i++) {
+			double t = inv[i].x.x + inv[i].y.y + inv[i].z.z;
+			if (t > 0) {
+				inv_trace += t;
+				num_valid++;
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			if (!(inv[i].x.x + inv[i].y.y + inv[i].z.z > 0)) {
+				inv[i] = (num_valid > 0 ? inv_trace / num_valid / 3 : 1.0) * math_public::Eye3;
+			}
+		}
+	}
 
-double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0);
+	// z = M^-1 * d_H
+	void apply(const double *d_H, double *z)const {
+		for (int i = 0; i < n; i++) {
+			math_public::Vec3 z_i = inv[i] * math_public::Vec3(d_H[3 * i], d_H[3 * i + 1], d_H[3 * i + 2]);
+			z[3 * i] = z_i.x;
+			z[3 * i + 1] = z_i.y;
+			z[3 * i + 2] = z_i.z;
+		}
+	}
+
+private:
+	int n; // Number of vertices
+	std::vector<math_public::Mat3> inv; // Inverse blocks
+};
+
+// Updates the geometry, the energy and the derivatives of the mesh with the tips, and returns the total energy
+double evaluate(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
+	sm.update_geo();
+	sm.update_energy();
+	double H = sm.get_sum_of_energy();
+	for (auto each_tip : tips) {
+		each_tip->calc_repulsion(sm); // This will also assign derivatives to vertices
+		H += each_tip->H;
+	}
+	return H;
+}
+
+class newton_cg_solver {
+	/**************************************************************************
+		Solves the Newton equation
+			Hessian * p = -d_H
+		approximately with the conjugate gradient method, where the products
+		of the Hessian and a vector z come from forward differences of the
+		analytic derivatives:
+			Hessian * z ~ (d_H(x + eps * z) - d_H(x)) / eps
+		The step eps * z is about sqrt(machine epsilon) of the size of the
+		mesh. The iteration stops when the residual is below eta * |d_H|, when
+		a direction of non-positive curvature is found, or after max_inner
+		products.
+	**************************************************************************/
+public:
+	newton_cg_solver(int max_inner, int size) :max_it(max_inner), n(size), r(size), z(size), Hz(size) {}
+
+	// The mesh must be at x_last with the derivatives d_H. Each product takes one evaluation,
+	// and the mesh is evaluated again at x_last before returning, so that the positions, the
+	// geometry and the derivatives of the mesh and the tips are those of x_last.
+	// Returns the number of products.
+	int direction(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, const double *d_H, double eta, double *p) {
+		double *x = sm.state.x.data();
+		const double *x_last = sm.state.x_last.data();
+		const double *d_H_eps = sm.state.d_H.data();
+
+		double x_max = 0;
+		for (int i = 0; i < n; i++) x_max = std::max(x_max, abs(x_last[i]));
+		const double fd_step = sqrt(std::numeric_limits<double>::epsilon()) * x_max;
+
+		double rr = 0;
+		for (int i = 0; i < n; i++) {
+			p[i] = 0;
+			r[i] = -d_H[i];
+			z[i] = r[i];
+			rr += r[i] * r[i];
+		}
+		double tolerance2 = eta * eta * rr;
+
+		int j = 0;
+		for (; j < max_it; j++) {
+			// Hz = Hessian * z
+			double z_max = 0;
+			for (int i = 0; i < n; i++) z_max = std::max(z_max, abs(z[i]));
+			double eps = fd_step / z_max;
+			for (int i = 0; i < n; i++) x[i] = x_last[i] + eps * z[i];
+			evaluate(sm, tips);
+			double zHz = 0;
+			for (int i = 0; i < n; i++) {
+				Hz[i] = (d_H_eps[i] - d_H[i]) / eps;
+				zHz += z[i] * Hz[i];
+			}
+
+			if (!(zHz > 0)) { // Not positive curvature
+				if (j == 0) {
+					for (int i = 0; i < n; i++) p[i] = -d_H[i];
+				}
+				j++;
+				break;
+			}
+
+			double a = rr / zHz;
+			double rr_new = 0;
+			for (int i = 0; i < n; i++) {
+				p[i] += a * z[i];
+				r[i] -= a * Hz[i];
+				rr_new += r[i] * r[i];
+			}
+			if (rr_new <= tolerance2) {
+				j++;
+				break;
+			}
+			double b = rr_new / rr;
+			for (int i = 0; i < n; i++) z[i] = r[i] + b * z[i];
+			rr = rr_new;
+		}
+
+		std::copy(x_last, x_last + n, x);
+		evaluate(sm, tips);
+		return j;
+	}
+
+private:
+	int max_it, n; // Maximum number of products and number of variables
+	std::vector<double> r, z, Hz; // Residual, conjugate direction and its product with the Hessian
+};
 
 void test_derivatives(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &facets);
-void force_profile(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &facets);
+void force_profile(MS::surface_mesh &sm);
+void scaling_benchmark(MS::surface_mesh &sm);
 
 int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 	auto &vertices = sm.vertices;
@@ -88,10 +440,13 @@ int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &t
 	} // End doing statistics
 
 
-	std::ofstream p_out, f_out, a_out;
-	p_out.open("F:\\p_out.txt");
-	f_out.open("F:\\f_out.txt");
-	a_out.open("F:\\a_out.txt");
+	// Frames are labeled by their order and the tip position
+	async_trajectory_writer p_out, f_out, a_out;
+	std::vector<double> a_frame(2 * N);
+	p_out.open("p_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	f_out.open("f_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	a_out.open("a_out.SimTraj", 2 * N, 2, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	int num_frames = 0;
 
 
 	switch (RUN_MODE) {
@@ -108,14 +463,13 @@ int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &t
 			sm.update_energy();
 
 			for (int i = 0; i < N; i++) {
-				p_out << vertices[i]->point->x << '\t' << vertices[i]->point->y << '\t' << vertices[i]->point->z << '\t';
-				math_public::Vec3 cur_d_h_all = vertices[i]->d_H;
-				f_out << cur_d_h_all.x << '\t' << cur_d_h_all.y << '\t' << cur_d_h_all.z << '\t';
-				a_out << vertices[i]->area << '\t' << vertices[i]->area0<<'\t';
+				a_frame[2 * i] = vertices[i]->area;
+				a_frame[2 * i + 1] = vertices[i]->area0;
 			}
-			p_out << std::endl;
-			f_out << std::endl;
-			a_out << std::endl;
+			p_out.write_frame(sm.state.x.data(), num_frames, a);
+			f_out.write_frame(sm.state.d_H.data(), num_frames, a);
+			a_out.write_frame(a_frame.data(), num_frames, a);
+			num_frames++;
 
 		}
 
@@ -123,13 +477,9 @@ int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &t
 		sm.update_geo();
 		sm.update_energy();
 
-		for (int i = 0; i < N; i++) {
-			p_out << vertices[i]->point->x << '\t' << vertices[i]->point->y << '\t' << vertices[i]->point->z << '\t';
-			math_public::Vec3 cur_d_h_all = vertices[i]->d_H;
-			f_out << cur_d_h_all.x << '\t' << cur_d_h_all.y << '\t' << cur_d_h_all.z << '\t';
-		}
-		p_out << std::endl;
-		f_out << std::endl;
+		p_out.write_frame(sm.state.x.data(), num_frames, tips[0]->point->x);
+		f_out.write_frame(sm.state.d_H.data(), num_frames, tips[0]->point->x);
+		num_frames++;
 		break;
 
 	case 1:
@@ -137,7 +487,11 @@ int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &t
 		break;
 
 	case 2:
-		force_profile(vertices, facets);
+		force_profile(sm);
+		break;
+
+	case 3:
+		scaling_benchmark(sm);
 		break;
 	}
 	
@@ -149,57 +503,105 @@ int MS::simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &t
 	return 0;
 }
 
+struct line_search_counts {
+	int calls = 0, probes = 0, gradients = 0;
+};
+line_search_counts line_search_totals; // Of the current minimization
+
+double line_search_backtracking(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess);
+double line_search_wolfe(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess);
+double line_search_parallel(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess);
+
+int minimize(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips);
+int minimize_fire(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips);
+void configure_tips(std::vector<MS::filament_tip*> &tips);
+void log_repulsion_errors(std::vector<MS::filament_tip*> &tips);
 int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 	/**************************************************************************
-		This function uses the conjugate gradient method to do the energy
-		minimization for vertices/facets system.
+		This function does the energy minimization, and reports the time spent
+		in each profiled phase to the log and to profile.SimOut.
 	**************************************************************************/
+	static int num_minimizations = 0;
+	num_minimizations++;
+
+	profiler::reset();
+	line_search_totals = line_search_counts();
+	int res;
+	{
+		PROFILE_SCOPE("minimization");
+		res = (MS::settings.minimizer == MS::FIRE ? minimize_fire(sm, tips) : minimize(sm, tips));
+	}
+	if (line_search_totals.calls > 0) {
+		LOG(INFO) << "Line searches: " << line_search_totals.calls << " Probes: " << line_search_totals.probes << " Gradients: " << line_search_totals.gradients
+			<< " Evaluations per line search: " << double(line_search_totals.probes + line_search_totals.gradients) / line_search_totals.calls;
+	}
+#if USE_PROFILER
+	profiler::report("minimization " + std::to_string(num_minimizations), "minimization", "profile.SimOut");
+#endif
+
+	return res;
+}
+int minimize(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
+	/**************************************************************************
+		This function does the energy minimization for vertices/facets system,
+		using steepest descent, the conjugate gradient method (optionally
+		block-Jacobi preconditioned), L-BFGS or Newton-CG, as selected by
+		settings.minimizer.
+	**************************************************************************/
+	using namespace MS;
 	auto &vertices = sm.vertices;
 
 	bool finished = false;
 	int N = vertices.size(); // Number of vertices
 	int N_t = tips.size(); // Number of tips
 	double H = 0, H_new = 0;
-	double *d_H = new double[3 * N];
-	double *d_H_new = new double[3 * N];
-	double *p = new double[3 * N]; // Search direction
+	double *d_H = sm.state.d_H_last.data();
+	double *d_H_new = sm.state.d_H.data(); // Derivatives are written here directly by the mesh
+	double *p = sm.state.p.data(); // Search direction
 	double alpha0;
 	double alpha; // alpha is the "portion" of distance that each vertex should go along the search vector.
 	double beta;
 
-	std::ofstream p_min_out, f_min_out, sd_min_out;
-	p_min_out.open("p_min_out.SimOut");
-	f_min_out.open("f_min_out.SimOut");
-	sd_min_out.open("sd_min_out.SimOut");
+	lbfgs_memory lbfgs(settings.minimizer == LBFGS ? settings.lbfgs_history : 0, 3 * N);
+	newton_cg_solver newton(settings.newton_max_inner, settings.minimizer == NewtonCG ? 3 * N : 0);
+	double d_H_norm0 = 0; // Norm of the first gradient, for the accuracy of the Newton steps
+	bool preconditioned = (settings.minimizer == PreconditionedCG);
+	block_jacobi_preconditioner precond(preconditioned ? N : 0);
+	std::vector<double> z(preconditioned ? 3 * N : 0), z_new(preconditioned ? 3 * N : 0); // Preconditioned d_H and d_H_new
+
+	// Frames are copied and written on background threads
+	async_trajectory_writer p_min_out, f_min_out, sd_min_out;
+	p_min_out.open("p_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	f_min_out.open("f_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	sd_min_out.open("sd_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
 	
+	configure_tips(tips);
+
 	// First calculation of energy and their derivatives
 	sm.update_geo();
 	sm.update_energy();
 	for (int i = 0; i < N_t; i++) {
-		// we only update neighbor facets once throughout the minimization.
+		// Neighbor facets are only updated when the vertices or the tip have moved far enough.
 		tips[i]->calc_repulsion(sm); // This will also assign derivatives to vertices
 		H += tips[i]->H;
 	}
 	H += sm.get_sum_of_energy();
 
 	// Initializing
-	for (int i = 0; i < N; i++) {
-		// Get d_H
-		math_public::Vec3 cur_d_h_all = vertices[i]->d_H;
-		d_H[i * 3] = cur_d_h_all.x;
-		d_H[i * 3 + 1] = cur_d_h_all.y;
-		d_H[i * 3 + 2] = cur_d_h_all.z;
-		for (int j = 0; j < 3; j++) {
-			// Initialize search direction
-			p[i * 3 + j] = -d_H[i * 3 + j];
-		}
-
-		// Store vertices location as the last location
-		vertices[i]->make_last();
-
+	std::copy(d_H_new, d_H_new + 3 * N, d_H);
+	if (preconditioned) {
+		precond.update(sm);
+		precond.apply(d_H, z.data());
 	}
+	for (int i = 0; i < 3 * N; i++) {
+		// Initialize search direction
+		p[i] = (preconditioned ? -z[i] : -d_H[i]);
+	}
+	// Store vertices location as the last location
+	sm.state.make_last();
 
 	int k = 0; // Iteration counter.
+	double alpha_last = 0, m_last = 0; // Of the last line search
 
 	while (true) {
 		k++;
@@ -216,12 +618,68 @@ int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 
 		// m is the inner product of the gradient and the search direcion, and must be non-negative.
 		double m = 0, m_new = 0;
-		if (USE_STEEPEST_DESCENT) {
+		double p_max = d_H_max; // Only L-BFGS would rescale the search direction
+		double alpha_guess = 0;
+		if (settings.minimizer == SteepestDescent) {
 			for (int i = 0; i < 3 * N; i++) {
 				p[i] = -d_H[i];
 				m += p[i] * d_H[i];
 			}
 		}
+		else if (settings.minimizer == LBFGS) {
+			lbfgs.direction(d_H, p);
+			for (int i = 0; i < 3 * N; i++) {
+				m += p[i] * d_H[i];
+			}
+			if (!(m < 0)) {
+				LOG(WARNING) << "Warning: L-BFGS direction is not a descent direction. Clearing history.";
+				lbfgs.clear();
+				m = 0;
+				for (int i = 0; i < 3 * N; i++) {
+					p[i] = -d_H[i];
+					m += p[i] * d_H[i];
+				}
+			}
+			if (lbfgs.size() > 0) {
+				// The step of a quasi-Newton method is naturally 1. Still, no vertex could move more than max_move.
+				alpha_guess = 1;
+				p_max = 0;
+				for (int i = 0; i < 3 * N; i++) {
+					if (p_max < abs(p[i])) p_max = abs(p[i]);
+				}
+				alpha0 = max_move / p_max;
+			}
+		}
+		else if (settings.minimizer == NewtonCG) {
+			double d_H_norm = 0;
+			for (int i = 0; i < 3 * N; i++) d_H_norm += d_H[i] * d_H[i];
+			d_H_norm = sqrt(d_H_norm);
+			if (k == 1) d_H_norm0 = d_H_norm;
+			// The residual relative to the gradient shrinks with the gradient, for quadratic convergence
+			double eta = std::min(0.5, d_H_norm / d_H_norm0);
+			int num_products = newton.direction(sm, tips, d_H, eta, p);
+			for (int i = 0; i < 3 * N; i++) {
+				m += p[i] * d_H[i];
+			}
+			if (!(m < 0)) {
+				LOG(WARNING) << "Warning: Newton direction is not a descent direction. Using steepest descent.";
+				m = 0;
+				for (int i = 0; i < 3 * N; i++) {
+					p[i] = -d_H[i];
+					m += p[i] * d_H[i];
+				}
+			}
+			else {
+				// The Newton step is naturally 1. Still, no vertex could move more than max_move.
+				alpha_guess = 1;
+				p_max = 0;
+				for (int i = 0; i < 3 * N; i++) {
+					if (p_max < abs(p[i])) p_max = abs(p[i]);
+				}
+				alpha0 = max_move / p_max;
+			}
+			LOG(INFO) << "Newton-CG eta: " << eta << " Hessian-vector products: " << num_products;
+		}
 		else { // Use conjugate gradient
 			for (int i = 0; i < 3*N; i++) {
 				m += p[i] * d_H[i];
@@ -232,11 +690,25 @@ int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 				for (int i = 0; i < N; i++) {
 					for (int j = 0; j < 3; j++) {
 						// Initialize search direction
-						p[i * 3 + j] = -d_H[i * 3 + j];
+						p[i * 3 + j] = (preconditioned ? -z[i * 3 + j] : -d_H[i * 3 + j]);
 						m += p[i * 3 + j] * d_H[i * 3 + j];
 					}
 				}
 			}
+			if (preconditioned) {
+				// The preconditioned direction is scaled like a Newton step.
+				alpha_guess = 1;
+				p_max = 0;
+				for (int i = 0; i < 3 * N; i++) {
+					if (p_max < abs(p[i])) p_max = abs(p[i]);
+				}
+				alpha0 = max_move / p_max;
+			}
+		}
+
+		if (alpha_guess == 0 && settings.line_search == WolfeLineSearch && alpha_last > 0) {
+			// The first order change of the energy is assumed to be the same as in the last iteration.
+			alpha_guess = alpha_last * m_last / m;
 		}
 
 		LOG(INFO) << "Current H: " << H << " m: " << m;
@@ -250,21 +722,41 @@ int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 			}
 		}
 
-		alpha = line_search(sm, tips, H, H_new, p, d_H_max, d_H_new, m, m_new, alpha0);
+		alpha = line_search(sm, tips, H, H_new, p, p_max, d_H_new, m, m_new, alpha0, alpha_guess);
+		alpha_last = alpha;
+		m_last = m;
 		// So far, H_new and d_H_new have already been updated in line_search.
 
-		// Temporary debugging output
-		std::ofstream t1;
-		t1.open("F:\\t1.txt");
-		for (int i = 0; i < 3 * N; i++) {
-			t1 << p[i] << '\t' << d_H[i] << '\t' << d_H_new[i] << std::endl;
-		}
-		LOG(DEBUG) << "t1 data dump complete.";
-		t1.close();
 		//std::cout << "New! Hn-H-c1*a*m=" << H_new - H - c1*alpha*m << "\t|mn|+c2*m=" << abs(m_new) + c2*m << std::endl;
 		
 
-		if (!USE_STEEPEST_DESCENT) { // Conjugate gradient method renewal of search direction.
+		if (settings.minimizer == LBFGS) {
+			if (alpha > 0 && !lbfgs.push(alpha, p, d_H, d_H_new)) {
+				LOG(INFO) << "L-BFGS correction pair skipped as curvature condition is not satisfied.";
+			}
+		}
+		else if (preconditioned) {
+			if (k % settings.pcg_refresh == 0) {
+				// The blocks are built at the new position, and the last d_H is preconditioned again with them.
+				precond.update(sm);
+				precond.apply(d_H, z.data());
+			}
+			precond.apply(d_H_new, z_new.data());
+			// Find beta (preconditioned Polak-Ribiere)
+			double a = 0, b = 0;
+			for (int i = 0; i < 3 * N; i++) {
+				a += d_H_new[i] * (z_new[i] - z[i]);
+				b += d_H[i] * z[i];
+			}
+			beta = (a >= 0) ? a / b : 0;
+
+			// Renew search direction
+			for (int i = 0; i < 3 * N; i++) {
+				p[i] = -z_new[i] + beta*p[i];
+			}
+			z.swap(z_new);
+		}
+		else if (settings.minimizer == ConjugateGradient) { // Conjugate gradient method renewal of search direction.
 			// Find beta (Fletcher-Reeves)
 			//double a = 0, b = 0;
 			//for (int i = 0; i < 3 * N; i++) {
@@ -286,90 +778,288 @@ int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
 			}
 		}
 
-		for (int i = 0; i < N; i++) {
-			// Store coordinates as last-time coordinates
-			vertices[i]->make_last();
-		}
+		// Store coordinates as last-time coordinates
+		sm.state.make_last();
 
 		// Renew H and d_H
 		H = H_new;
-		for (int i = 0; i < 3 * N; i++) {
-			d_H[i] = d_H_new[i];
-		}
+		std::copy(d_H_new, d_H_new + 3 * N, d_H);
 
 		// Finish off and get ready for the next iteration.
 		LOG(INFO) << "H_new: " << H_new << " m_new: " << m_new;
+		log_repulsion_errors(tips);
+		PROFILE_SCOPE("output");
+		// Frames are labeled by the iteration and the energy
+		p_min_out.write_frame(sm.state.x.data(), k, H);
+		f_min_out.write_frame(d_H, k, H);
+		sd_min_out.write_frame(p, k, H);
+	}
+
+	f_min_out.close();
+	p_min_out.close();
+	sd_min_out.close();
+
+	return 0;
+}
+int minimize_fire(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips) {
+	/**************************************************************************
+		This function does the energy minimization with FIRE, the fast
+		inertial relaxation engine (Bitzek et al., 2006).
+
+		The vertices move with unit mass under the force -d_H. While the
+		power F*v is positive, the velocity is mixed towards the direction of
+		the force, and the time step grows after fire_n_min such steps. When
+		the power is not positive, the velocity is cleared and the time step
+		shrinks. There is no line search, so every step takes exactly one
+		evaluation of the energy and derivatives.
+
+		No vertex moves more than max_move in one step. A step that makes the
+		area of any vertex non-positive is taken back, and treated as a step
+		with negative power.
+	**************************************************************************/
+	using namespace MS;
+	auto &vertices = sm.vertices;
+
+	int N = vertices.size(); // Number of vertices
+	double *x = sm.state.x.data();
+	const double *x_last = sm.state.x_last.data();
+	double *d_H = sm.state.d_H.data(); // Derivatives are written here directly by the mesh
+	double *d_H_last = sm.state.d_H_last.data();
+	double *v = sm.state.p.data(); // Velocity
+
+	// Frames are copied and written on background threads
+	async_trajectory_writer p_min_out, f_min_out, sd_min_out;
+	p_min_out.open("p_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	f_min_out.open("f_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+	sd_min_out.open("sd_min_out.SimTraj", 3 * N, 3, settings.trajectory_single_precision, settings.output_buffers, settings.output_every, settings.output_drop_when_full);
+
+	configure_tips(tips);
+
+	int num_evaluations = 0;
+	auto max_abs = [N](const double *a) {
+		double a_max = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			if (a_max < abs(a[i])) a_max = abs(a[i]);
+		}
+		return a_max;
+	};
+
+	double H = evaluate(sm, tips);
+	num_evaluations++;
+	double d_H_max = max_abs(d_H);
+	// The first step moves the vertex with the largest force by a tenth of max_move.
+	double dt = (d_H_max > 0 ? sqrt(0.1 * max_move / d_H_max) : 0);
+	double dt_max = fire_dt_max_factor * dt;
+	double alpha = fire_alpha_start;
+	int n_positive = 0;
+	std::fill(v, v + 3 * N, 0.0);
+	sm.state.make_last();
+	std::copy(d_H, d_H + 3 * N, d_H_last);
+
+	int k = 0; // Step counter
+	while (true) {
+		k++;
+		d_H_max = max_abs(d_H);
+		if (d_H_max < h_eps) break; // Force is almost zero
+		if (k > settings.fire_max_steps) {
+			LOG(WARNING) << "FIRE stopped after " << settings.fire_max_steps << " steps. Max gradient: " << d_H_max;
+			break;
+		}
+
+		// Power of the force, and mixing of the velocity
+		double P = 0, v_norm2 = 0, f_norm2 = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			P -= d_H[i] * v[i];
+			v_norm2 += v[i] * v[i];
+			f_norm2 += d_H[i] * d_H[i];
+		}
+		if (P > 0) {
+			double mix = alpha * sqrt(v_norm2 / f_norm2);
+			for (int i = 0; i < 3 * N; i++) {
+				v[i] = (1 - alpha) * v[i] - mix * d_H[i];
+			}
+			if (++n_positive > fire_n_min) {
+				dt = std::min(dt * fire_f_inc, dt_max);
+				alpha *= fire_f_alpha;
+			}
+		}
+		else {
+			std::fill(v, v + 3 * N, 0.0);
+			dt *= fire_f_dec;
+			alpha = fire_alpha_start;
+			n_positive = 0;
+		}
+
+		// Semi-implicit Euler step, limited to max_move for each vertex
+		for (int i = 0; i < 3 * N; i++) {
+			v[i] -= dt * d_H[i];
+		}
 		for (int i = 0; i < N; i++) {
-			p_min_out << vertices[i]->point->x << '\t' << vertices[i]->point->y << '\t' << vertices[i]->point->z << '\t';
+			double dx[3], dx_norm2 = 0;
 			for (int j = 0; j < 3; j++) {
-				f_min_out << d_H[i * 3 + j] << '\t';
-				sd_min_out << p[i * 3 + j] << '\t';
+				dx[j] = dt * v[3 * i + j];
+				dx_norm2 += dx[j] * dx[j];
 			}
+			double scale = (dx_norm2 > max_move * max_move ? max_move / sqrt(dx_norm2) : 1);
+			for (int j = 0; j < 3; j++) {
+				x[3 * i + j] = x_last[3 * i + j] + scale * dx[j];
+			}
+		}
+
+		double H_new = evaluate(sm, tips);
+		num_evaluations++;
+
+		bool area_positive = true;
+		for (int i = 0; i < N && area_positive; i++) {
+			area_positive = (vertices[i]->area > 0);
 		}
-		p_min_out << std::endl;
-		f_min_out << std::endl;
-		sd_min_out << std::endl;
+		if (!area_positive) {
+			LOG(INFO) << "[FIRE] Area is negative. Taking the step back.";
+			std::copy(x_last, x_last + 3 * N, x);
+			std::copy(d_H_last, d_H_last + 3 * N, d_H);
+			std::fill(v, v + 3 * N, 0.0);
+			dt *= fire_f_dec;
+			alpha = fire_alpha_start;
+			n_positive = 0;
+			continue;
+		}
+
+		H = H_new;
+		sm.state.make_last();
+		std::copy(d_H, d_H + 3 * N, d_H_last);
+
+		LOG(INFO) << "Step " << k << " H: " << H << " Max gradient: " << d_H_max << " dt: " << dt << " alpha: " << alpha;
+		log_repulsion_errors(tips);
+		PROFILE_SCOPE("output");
+		// Frames are labeled by the step and the energy
+		p_min_out.write_frame(x, k, H);
+		f_min_out.write_frame(d_H, k, H);
+		sd_min_out.write_frame(v, k, H);
 	}
+	LOG(INFO) << "FIRE steps: " << k << " Evaluations: " << num_evaluations << " H: " << H;
 
 	f_min_out.close();
 	p_min_out.close();
 	sd_min_out.close();
 
-	delete[]d_H;
-	delete[]d_H_new;
-	delete[]p;
-
 	return 0;
 }
-double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0) {
+void configure_tips(std::vector<MS::filament_tip*> &tips) {
+	using MS::settings;
+	for (auto each_tip : tips) {
+		each_tip->cutoff = settings.repulsion_cutoff;
+		each_tip->skin = settings.repulsion_skin;
+		each_tip->far_ratio = settings.repulsion_far_ratio;
+		each_tip->point_ratio = settings.repulsion_point_ratio;
+	}
+}
+void log_repulsion_errors(std::vector<MS::filament_tip*> &tips) {
+	using MS::settings;
+	if (settings.repulsion_cutoff > 0) {
+		double H_cutoff_error = 0;
+		int n_list_builds = 0;
+		for (auto each_tip : tips) {
+			H_cutoff_error += each_tip->H_cutoff_error;
+			n_list_builds += each_tip->n_list_builds;
+		}
+		LOG(INFO) << "Bound of repulsion energy skipped by cutoff: " << H_cutoff_error << " Neighbor list builds so far: " << n_list_builds;
+	}
+	if (settings.repulsion_far_ratio > 0 || settings.repulsion_point_ratio > 0) {
+		double H_far_error = 0;
+		int n_far_quadrature = 0, n_far_point = 0;
+		for (auto each_tip : tips) {
+			H_far_error += each_tip->H_far_error;
+			n_far_quadrature += each_tip->n_far_quadrature;
+			n_far_point += each_tip->n_far_point;
+		}
+		LOG(INFO) << "Estimated error of far field repulsion: " << H_far_error << " Facets by quadrature: " << n_far_quadrature << " by centroid: " << n_far_point;
+	}
+}
+double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess) {
+	line_search_totals.calls++;
+	if (MS::settings.parallel_line_search >= 2) {
+		return line_search_parallel(sm, tips, H, H_new, p, d_H_max, d_H_new, m, m_new, alpha0, alpha_guess);
+	}
+	if (MS::settings.line_search == MS::WolfeLineSearch) {
+		return line_search_wolfe(sm, tips, H, H_new, p, d_H_max, d_H_new, m, m_new, alpha0, alpha_guess);
+	}
+	return line_search_backtracking(sm, tips, H, H_new, p, d_H_max, d_H_new, m, m_new, alpha0, alpha_guess);
+}
+double line_search_backtracking(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess) {
 	/**************************************************************************
 	Purpose:
-		This function does the line search for a given search direction.
+		This function does the line search for a given search direction,
+		by growing alpha with a linearized force and shrinking it by tau.
 
 	Parameters:
+		d_H_max: max absolute value of the search direction components.
+		d_H_new: the derivatives in the mesh state, which must hold the
+			derivatives at the start when called.
 		alpha0: max value that alpha could take.
+		alpha_guess: first trial of alpha if positive.
+
+	Trials are evaluated without derivatives first, and the derivatives are
+	calculated only when the energy decreases.
 	**************************************************************************/
+	PROFILE_SCOPE("line_search");
 	int N = sm.vertices.size();
 	auto &vertices = sm.vertices;
 	int N_t = tips.size();
+	double *x = sm.state.x.data();
+	const double *x_last = sm.state.x_last.data();
 
 	double MIN_D_ALPHA_FAC = 1e-15; // Minimum delta
 
-	double alpha_init = -0.1 * abs(H) / m; // In m^2/J
+	double alpha_init = (alpha_guess > 0 ? alpha_guess : -0.1 * abs(H) / m); // In m^2/J
 	double alpha = 0;
 	double d_alpha = std::fmin(alpha_init, alpha0 * 0.5); // To ensure that 1st alpha is not larger than alpha0
 	double H_p = H, m_p = m; // Previous H and m
-	bool accepted = false;
 	bool backtrack = true; // Whether alpha is too big for some reason so that we need to decrease alpha and do further iterations
+	int num_probes = 0, num_gradients = 0;
+
+	// When returning an alpha other than the last trial, the vertices are moved back to alpha and
+	// evaluated again. d_H_new might hold the derivatives of a later trial that was rejected by its
+	// slope, and the geometry is at the last probe.
+	auto return_to_alpha = [&]() {
+		for (int i = 0; i < 3 * N; i++) {
+			x[i] = x_last[i] + alpha * p[i];
+		}
+		H_new = evaluate(sm, tips);
+		num_gradients++;
+		m_new = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			m_new += p[i] * d_H_new[i];
+		}
+		LOG(DEBUG) << "Line search probes: " << num_probes << " Gradients: " << num_gradients;
+		line_search_totals.probes += num_probes;
+		line_search_totals.gradients += num_gradients;
+	};
 
 	while (true) {
-		accepted = true;
 		backtrack = false;
 
 		alpha += d_alpha;
 		if(alpha > alpha0){
 			alpha -= d_alpha;
 			LOG(INFO) << "Returning alpha as " << alpha << " as it reaches maximum";
+			return_to_alpha();
 			return alpha; // Ensure this won't happen for the 1st iteration, because we cannot let alpha to be zero.
 		}
 
-		// Change the position and renew energy
-		for (int i = 0; i < N; i++) {
-			vertices[i]->point->x = vertices[i]->point_last->x + alpha * p[i * 3];
-			vertices[i]->point->y = vertices[i]->point_last->y + alpha * p[i * 3 + 1];
-			vertices[i]->point->z = vertices[i]->point_last->z + alpha * p[i * 3 + 2];
+		// Change the position and renew energy. Derivatives are not needed unless the energy decreases.
+		for (int i = 0; i < 3 * N; i++) {
+			x[i] = x_last[i] + alpha * p[i];
 		}
-		sm.update_geo();
-		sm.update_energy();
+		sm.update_geo_value();
+		sm.update_energy_value();
 		for (int i = 0; i < N_t; i++) {
-			// we do not update neighbor facets in line search.
-			tips[i]->calc_repulsion(sm); // This will also assign derivatives to vertices
+			tips[i]->calc_repulsion_value(sm);
 		}
+		num_probes++;
 
 		// Make sure that area is not negative
 		for (int i = 0; i < N; i++) {
 			if (vertices[i]->area <= 0) {
-				accepted = false;
 				backtrack = true; // Because H = infty, we also need to do backtracking
 				LOG(INFO) << "[BACKTRACK] Area is negative.";
 				break;
@@ -388,23 +1078,27 @@ double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, d
 			backtrack = true;
 		} // Otherwise, Armijo condition is satisfied.
 
-		// Renew energy derivatives and m value
-		m_new = 0;
-		for (int i = 0; i < N; i++) {
-			math_public::Vec3 cur_d_h_all = vertices[i]->d_H;
-			d_H_new[i * 3] = cur_d_h_all.x;
-			d_H_new[i * 3 + 1] = cur_d_h_all.y;
-			d_H_new[i * 3 + 2] = cur_d_h_all.z;
-			for (int j = 0; j < 3; j++) {
-				m_new += p[i * 3 + j] * d_H_new[i * 3 + j];
+		if (!backtrack) {
+			// Full evaluation with derivatives. The energy is the same as the one above.
+			sm.update_geo();
+			sm.update_energy();
+			for (int i = 0; i < N_t; i++) {
+				tips[i]->calc_repulsion(sm); // This will also assign derivatives to vertices
 			}
+			num_gradients++;
+
+			// Renew m value. Energy derivatives are already in d_H_new.
+			m_new = 0;
+			for (int i = 0; i < 3 * N; i++) {
+				m_new += p[i] * d_H_new[i];
+			}
+			if (m_new > 0) {
+				LOG(INFO) << "[BACKTRACK] New force along search direction.";
+				backtrack = true;
+			}
+
+			LOG(DEBUG) << "H_new: " << H_new << " m_new: " << m_new;
 		}
-		if (m_new > 0) {
-			LOG(INFO) << "[BACKTRACK] New force along search direction.";
-			backtrack = true;
-		}
-		
-		LOG(DEBUG) << "H_new: " << H_new << " m_new: " << m_new;
 
 		if(backtrack){
 			alpha -= d_alpha; // Get back to last alpha
@@ -419,6 +1113,7 @@ double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, d
 			if (d_H_max * d_alpha <= MIN_D_ALPHA_FAC) {
 				LOG(INFO) << "Returning alpha as " << alpha << " as d_alpha is too small";
 				if (alpha == 0.0) LOG(WARNING) << "d_alpha is too small, and returned alpha is zero.";
+				return_to_alpha();
 				return alpha;
 			}
 
@@ -440,25 +1135,16 @@ double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, d
 				vertices[ind]->point->y = vertices[ind]->point_last->y + (alpha + 2e-2) * p[ind * 3 + 1];
 				vertices[ind]->point->z = vertices[ind]->point_last->z + (alpha + 2e-2) * p[ind * 3 + 2];
 
-				vertices[ind]->update_geo();
-				for (int i = 0; i < vertices[ind]->neighbors; i++) {
-					vertices[ind]->n[i]->update_geo();
-				}
-				vertices[ind]->update_energy(sm.osm_p);
-				for (int i = 0; i < vertices[ind]->neighbors; i++) {
-					vertices[ind]->n[i]->update_energy(sm.osm_p);
-				}
+				sm.mark_moved(ind);
+				sm.update_local();
 
 				// Renew energy
-				double H_new_n = 0;
-				for (int i = 0; i < N; i++) {
-					H_new_n += vertices[i]->H;
-				}
+				double H_new_n = sm.get_sum_of_energy();
 
 				// Renew energy derivatives and m value
 				double m_new_n = 0;
 				for (int i = 0; i < N; i++) {
-					math_public::Vec3 cur_d_h_all = vertices[i]->d_H;
+					math_public::Vec3 cur_d_h_all = *(vertices[i]->d_H);
 					d_H_new[i * 3] = cur_d_h_all.x;
 					d_H_new[i * 3 + 1] = cur_d_h_all.y;
 					d_H_new[i * 3 + 2] = cur_d_h_all.z;
@@ -475,6 +1161,9 @@ double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, d
 		
 		if (!USE_LINE_SEARCH || abs(m_new) <= -c2 * m) { // Curvature condition satisfied. Good.
 			LOG(INFO) << "Returning alpha as " << alpha << " as it fits search criteria.";
+			LOG(DEBUG) << "Line search probes: " << num_probes << " Gradients: " << num_gradients;
+			line_search_totals.probes += num_probes;
+			line_search_totals.gradients += num_gradients;
 			return alpha;
 		} // Curvature condition not satisfied
 
@@ -492,6 +1181,386 @@ double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, d
 
 	}
 }
+namespace {
+	// Minimizer of the cubic with the values and slopes at a0 and a1. NaN if it has no minimizer.
+	double cubic_minimizer(double a0, double f0, double g0, double a1, double f1, double g1) {
+		double d1 = g0 + g1 - 3 * (f0 - f1) / (a0 - a1);
+		double disc = d1 * d1 - g0 * g1;
+		if (disc < 0) return std::numeric_limits<double>::quiet_NaN();
+		double d2 = (a1 > a0 ? 1 : -1) * sqrt(disc);
+		return a1 - (a1 - a0) * (g1 + d2 - d1) / (g1 - g0 + 2 * d2);
+	}
+	// Minimizer of the quadratic with the value and slope at a0 and the value at a1. NaN if it has no minimizer.
+	double quadratic_minimizer(double a0, double f0, double g0, double a1, double f1) {
+		double da = a1 - a0;
+		double curv = f1 - f0 - g0 * da;
+		if (!(curv > 0)) return std::numeric_limits<double>::quiet_NaN();
+		return a0 - g0 * da * da / (2 * curv);
+	}
+}
+double line_search_wolfe(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess) {
+	/**************************************************************************
+	Purpose:
+		This function finds an alpha satisfying the strong Wolfe conditions
+			H(alpha) <= H + c1 * alpha * m
+			|m(alpha)| <= c2 * |m|
+		(Nocedal and Wright, algorithms 3.5 and 3.6).
+
+	Parameters are the same as line_search_backtracking().
+
+	The first phase grows alpha until an interval containing acceptable
+	points is bracketed, and the second phase shrinks the interval. New
+	trials are the minimizers of the cubic fitted to the energies and
+	slopes at both ends, or of the quadratic when only the energy of one
+	end is known, kept away from the ends of the interval.
+
+	As in line_search_backtracking(), trials are evaluated without
+	derivatives first, and the derivatives are calculated only when the
+	Armijo condition is satisfied. When the returned alpha is not the last
+	evaluation with derivatives (or a probe came after it), the mesh and
+	the tips are evaluated again at alpha, so that the positions, geometry,
+	energies and derivatives are all those of the returned alpha.
+	**************************************************************************/
+	PROFILE_SCOPE("line_search");
+	int N = sm.vertices.size();
+	auto &vertices = sm.vertices;
+	int N_t = tips.size();
+	double *x = sm.state.x.data();
+	const double *x_last = sm.state.x_last.data();
+
+	const double MIN_D_ALPHA_FAC = 1e-15; // Minimum width of the interval, times d_H_max
+	const int max_trials = 30;
+	int num_probes = 0, num_gradients = 0;
+	// alpha of the full evaluation held by the mesh, which is the start when called. NaN after a probe.
+	double evaluated_alpha = 0, probed_alpha = 0;
+
+	// Energy at alpha without derivatives. Infinite if the area of any vertex is not positive.
+	auto probe = [&](double alpha) {
+		for (int i = 0; i < 3 * N; i++) {
+			x[i] = x_last[i] + alpha * p[i];
+		}
+		probed_alpha = alpha;
+		evaluated_alpha = std::numeric_limits<double>::quiet_NaN();
+		sm.update_geo_value();
+		sm.update_energy_value();
+		for (int i = 0; i < N_t; i++) {
+			tips[i]->calc_repulsion_value(sm);
+		}
+		num_probes++;
+		for (int i = 0; i < N; i++) {
+			if (vertices[i]->area <= 0) return std::numeric_limits<double>::infinity();
+		}
+		double H_alpha = sm.get_sum_of_energy();
+		for (int i = 0; i < N_t; i++) {
+			H_alpha += tips[i]->H;
+		}
+		return H_alpha;
+	};
+	// Slope at the position of the last probe, with the derivatives written to d_H_new
+	auto gradient = [&]() {
+		sm.update_geo();
+		sm.update_energy();
+		for (int i = 0; i < N_t; i++) {
+			tips[i]->calc_repulsion(sm); // This will also assign derivatives to vertices
+		}
+		num_gradients++;
+		evaluated_alpha = probed_alpha;
+		double m_alpha = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			m_alpha += p[i] * d_H_new[i];
+		}
+		return m_alpha;
+	};
+	auto finish = [&](double alpha, double H_alpha, double m_alpha, const char *reason) {
+		if (!(evaluated_alpha == alpha)) {
+			for (int i = 0; i < 3 * N; i++) {
+				x[i] = x_last[i] + alpha * p[i];
+			}
+			H_alpha = evaluate(sm, tips);
+			num_gradients++;
+			m_alpha = 0;
+			for (int i = 0; i < 3 * N; i++) {
+				m_alpha += p[i] * d_H_new[i];
+			}
+		}
+		H_new = H_alpha;
+		m_new = m_alpha;
+		LOG(INFO) << "Returning alpha as " << alpha << " " << reason << ". Probes: " << num_probes << " Gradients: " << num_gradients;
+		line_search_totals.probes += num_probes;
+		line_search_totals.gradients += num_gradients;
+		return alpha;
+	};
+	auto sufficient_decrease = [&](double alpha, double H_alpha) {
+		return H_alpha <= H + c1 * alpha * m;
+	};
+	auto curvature = [&](double m_alpha) {
+		return abs(m_alpha) <= -c2 * m;
+	};
+
+	// Interval [lo, hi] (hi could be smaller than lo). lo satisfies the Armijo condition and has
+	// derivatives. The slope at hi is only known if hi_has_slope.
+	double lo = 0, H_lo = H, m_lo = m;
+	double hi = 0, H_hi = 0, m_hi = 0;
+	bool hi_has_slope = false;
+
+	// Bracketing
+	double alpha = std::fmin(alpha_guess > 0 ? alpha_guess : -0.1 * abs(H) / m, alpha0);
+	bool bracketed = false;
+	for (int trial = 0; trial < max_trials && !bracketed; trial++) {
+		double H_alpha = probe(alpha);
+		if (!sufficient_decrease(alpha, H_alpha) || (trial > 0 && H_alpha >= H_lo)) {
+			hi = alpha; H_hi = H_alpha; hi_has_slope = false;
+			bracketed = true;
+			break;
+		}
+		double m_alpha = gradient();
+		if (curvature(m_alpha)) return finish(alpha, H_alpha, m_alpha, "as it satisfies the strong Wolfe conditions");
+		if (m_alpha >= 0) {
+			hi = lo; H_hi = H_lo; m_hi = m_lo; hi_has_slope = true;
+			lo = alpha; H_lo = H_alpha; m_lo = m_alpha;
+			bracketed = true;
+			break;
+		}
+		if (alpha >= alpha0) return finish(alpha, H_alpha, m_alpha, "as it reaches maximum");
+		// Still descending. Extrapolate with the cubic through the last two points.
+		double next = cubic_minimizer(lo, H_lo, m_lo, alpha, H_alpha, m_alpha);
+		if (!(next >= 1.1 * alpha)) next = 4 * alpha;
+		next = std::fmin(std::fmin(next, 4 * alpha), alpha0);
+		lo = alpha; H_lo = H_alpha; m_lo = m_alpha;
+		alpha = next;
+	}
+	if (!bracketed) return finish(lo, H_lo, m_lo, "as the bracketing does not end");
+
+	// Zooming
+	for (int trial = 0; trial < max_trials; trial++) {
+		double width = abs(hi - lo);
+		if (d_H_max * width <= MIN_D_ALPHA_FAC) {
+			if (lo == 0.0) LOG(WARNING) << "Line search interval is too small, and returned alpha is zero.";
+			return finish(lo, H_lo, m_lo, "as the interval is too small");
+		}
+		double next = (hi_has_slope ? cubic_minimizer(lo, H_lo, m_lo, hi, H_hi, m_hi) : quadratic_minimizer(lo, H_lo, m_lo, hi, H_hi));
+		double a_min = std::fmin(lo, hi) + 0.1 * width, a_max = std::fmax(lo, hi) - 0.1 * width;
+		if (!(next >= a_min && next <= a_max)) next = (next < a_min ? a_min : (next > a_max ? a_max : (lo + hi) / 2));
+		alpha = next;
+
+		double H_alpha = probe(alpha);
+		if (!sufficient_decrease(alpha, H_alpha) || H_alpha >= H_lo) {
+			hi = alpha; H_hi = H_alpha; hi_has_slope = false;
+			continue;
+		}
+		double m_alpha = gradient();
+		if (curvature(m_alpha)) return finish(alpha, H_alpha, m_alpha, "as it satisfies the strong Wolfe conditions");
+		if (m_alpha * (hi - lo) >= 0) {
+			hi = lo; H_hi = H_lo; m_hi = m_lo; hi_has_slope = true;
+		}
+		lo = alpha; H_lo = H_alpha; m_lo = m_alpha;
+	}
+	return finish(lo, H_lo, m_lo, "as the zooming does not end");
+}
+
+class mesh_replicas {
+	/**************************************************************************
+		Independent copies of a mesh and its tips, each with its own positions,
+		geometry and derivatives, so that the copies could be evaluated at the
+		same time on different threads. The loops inside the evaluation of a
+		copy run serially on its thread.
+
+		The copies are only rebuilt when the mesh or the number of copies
+		changes. The tips are copied on every prepare().
+	**************************************************************************/
+public:
+	~mesh_replicas() { clear(); }
+
+	void prepare(const MS::surface_mesh &sm, const std::vector<MS::filament_tip*> &tips, int num) {
+		int N = sm.vertices.size();
+		if (source != &sm || (int)meshes.size() != num || (num > 0 && (int)meshes[0]->vertices.size() != N)) {
+			clear();
+			source = &sm;
+			for (int r = 0; r < num; r++) {
+				MS::surface_mesh *copy = new MS::surface_mesh();
+				mesh_copy(sm, *copy);
+				meshes.push_back(copy);
+			}
+			replica_tips.resize(num);
+		}
+		for (int r = 0; r < num; r++) {
+			// The initial areas and the pressure might have been changed since the copies were built.
+			for (int i = 0; i < N; i++) {
+				meshes[r]->vertices[i]->area0 = sm.vertices[i]->area0;
+			}
+			meshes[r]->osm_p = sm.osm_p;
+
+			auto &copies = replica_tips[r];
+			if (copies.size() != tips.size()) {
+				clear_tips(copies);
+				for (size_t t = 0; t < tips.size(); t++) copies.push_back(new MS::filament_tip(new math_public::Vec3()));
+			}
+			for (size_t t = 0; t < tips.size(); t++) {
+				*(copies[t]->point) = *(tips[t]->point);
+			}
+			configure_tips(copies);
+		}
+	}
+
+	inline MS::surface_mesh& mesh(int r) { return *meshes[r]; }
+	inline std::vector<MS::filament_tip*>& tips(int r) { return replica_tips[r]; }
+
+private:
+	const MS::surface_mesh *source = nullptr;
+	std::vector<MS::surface_mesh*> meshes;
+	std::vector<std::vector<MS::filament_tip*>> replica_tips;
+
+	static void clear_tips(std::vector<MS::filament_tip*> &copies) {
+		for (auto each_tip : copies) {
+			delete each_tip->point;
+			delete each_tip;
+		}
+		copies.clear();
+	}
+	void clear() {
+		for (auto copy : meshes) {
+			for (auto each_facet : copy->facets) delete each_facet;
+			for (auto each_edge : copy->edges) delete each_edge;
+			for (auto each_vertex : copy->vertices) delete each_vertex;
+			delete copy;
+		}
+		meshes.clear();
+		for (auto &copies : replica_tips) clear_tips(copies);
+		replica_tips.clear();
+		source = nullptr;
+	}
+};
+mesh_replicas line_search_replicas; // Used by line_search_parallel()
+
+double line_search_parallel(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess) {
+	/**************************************************************************
+	Purpose:
+		This function evaluates settings.parallel_line_search trials of alpha
+		at the same time, each on its own copy of the mesh, and returns the
+		trial of the lowest energy among those satisfying the strong Wolfe
+		conditions.
+
+	Parameters are the same as line_search_backtracking().
+
+	The first round of trials is spread geometrically around the first
+	trial of line_search_wolfe(), by factors of 2, and scaled down if the
+	largest is beyond alpha0. If none satisfies the conditions, the trials
+	are scanned in ascending order as in the bracketing of
+	line_search_wolfe(): lo is the last trial satisfying the Armijo
+	condition with a descending slope, and hi is the first trial after it
+	that does not. The next round is spread evenly inside [lo, hi], or
+	geometrically beyond lo if nothing is bracketed, and evenly inside
+	[lo, alpha0] if that would go beyond alpha0. So the trials of a round
+	are always distinct.
+
+	Every trial is evaluated with derivatives on its copy, and the mesh and
+	the tips themselves are evaluated once more at the returned alpha.
+
+	After max_rounds, lo is returned. If lo is still the start,
+	line_search_wolfe() takes over.
+
+	With fewer threads than trials, this takes longer than
+	line_search_wolfe(), which needs about 3 evaluations per search.
+	**************************************************************************/
+	PROFILE_SCOPE("line_search");
+	int N = sm.vertices.size();
+	int K = MS::settings.parallel_line_search;
+	double *x = sm.state.x.data();
+	const double *x_last = sm.state.x_last.data();
+
+	const int max_rounds = 3;
+
+	line_search_replicas.prepare(sm, tips, K);
+	std::vector<double> alphas(K), H_trial(K), m_trial(K);
+	std::vector<char> valid(K);
+	std::vector<int> order(K);
+
+	double lo = 0, H_lo = H;
+
+	auto finish = [&](double alpha, int rounds, const char *reason) {
+		for (int i = 0; i < 3 * N; i++) {
+			x[i] = x_last[i] + alpha * p[i];
+		}
+		H_new = evaluate(sm, tips);
+		m_new = 0;
+		for (int i = 0; i < 3 * N; i++) {
+			m_new += p[i] * d_H_new[i];
+		}
+		LOG(INFO) << "Returning alpha as " << alpha << " " << reason << ". Rounds of " << K << " parallel trials: " << rounds;
+		line_search_totals.gradients += rounds * K + 1;
+		return alpha;
+	};
+
+	double alpha_first = std::fmin(alpha_guess > 0 ? alpha_guess : -0.1 * abs(H) / m, alpha0);
+	for (int r = 0; r < K; r++) {
+		alphas[r] = alpha_first * pow(2.0, r - (K - 1) / 2);
+	}
+	if (alphas[K - 1] > alpha0) {
+		double scale = alpha0 / alphas[K - 1];
+		for (int r = 0; r < K - 1; r++) alphas[r] *= scale;
+		alphas[K - 1] = alpha0;
+	}
+
+	for (int round = 1; round <= max_rounds; round++) {
+		parallel::parallel_for(0, K, [&](int r) {
+			MS::surface_mesh &copy = line_search_replicas.mesh(r);
+			double *x_copy = copy.state.x.data();
+			for (int i = 0; i < 3 * N; i++) {
+				x_copy[i] = x_last[i] + alphas[r] * p[i];
+			}
+			H_trial[r] = evaluate(copy, line_search_replicas.tips(r));
+			valid[r] = true;
+			for (int i = 0; i < N; i++) {
+				if (copy.vertices[i]->area <= 0) valid[r] = false;
+			}
+			const double *d_H_copy = copy.state.d_H.data();
+			double m_alpha = 0;
+			for (int i = 0; i < 3 * N; i++) {
+				m_alpha += p[i] * d_H_copy[i];
+			}
+			m_trial[r] = m_alpha;
+		}, 1);
+
+		auto sufficient_decrease = [&](int r) {
+			return valid[r] && H_trial[r] <= H + c1 * alphas[r] * m;
+		};
+		int best = -1;
+		for (int r = 0; r < K; r++) {
+			if (sufficient_decrease(r) && abs(m_trial[r]) <= -c2 * m && (best < 0 || H_trial[r] < H_trial[best])) best = r;
+		}
+		if (best >= 0) return finish(alphas[best], round, "as it satisfies the strong Wolfe conditions");
+
+		// Bracketing, with the trials in ascending order
+		for (int r = 0; r < K; r++) order[r] = r;
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return alphas[a] < alphas[b]; });
+		int new_lo = -1;
+		double hi = -1;
+		for (int r : order) {
+			if (alphas[r] <= lo) continue;
+			if (!sufficient_decrease(r) || H_trial[r] >= H_lo) { hi = alphas[r]; break; }
+			if (m_trial[r] >= 0) { hi = alphas[r]; break; }
+			new_lo = r;
+		}
+		if (new_lo >= 0) {
+			lo = alphas[new_lo]; H_lo = H_trial[new_lo];
+		}
+		if (hi < 0 && lo >= alpha0) return finish(lo, round, "as it reaches maximum");
+
+		// Next round
+		bool beyond_max = (lo * pow(2.0, K) > alpha0);
+		for (int r = 0; r < K; r++) {
+			if (hi > 0) alphas[r] = lo + (hi - lo) * (r + 1) / (K + 1);
+			else if (beyond_max) alphas[r] = (r == K - 1 ? alpha0 : lo + (alpha0 - lo) * (r + 1) / K);
+			else alphas[r] = lo * pow(2.0, r + 1);
+		}
+		if (round == max_rounds) {
+			if (lo > 0) return finish(lo, round, "as the rounds do not end");
+			line_search_totals.gradients += round * K;
+			LOG(INFO) << "No parallel trial satisfies the Armijo condition. Using the sequential line search.";
+		}
+	}
+	return line_search_wolfe(sm, tips, H, H_new, p, d_H_max, d_H_new, m, m_new, alpha0, 0);
+}
 
 void test_derivatives(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &facets) {
 	// Test local properties (main)
@@ -605,24 +1674,18 @@ void test_derivatives(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*
 
 }
 
-void force_profile(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &facets) {
+void force_profile(MS::surface_mesh &sm) {
 	// TODO: Consider facet interactions
+	auto &vertices = sm.vertices;
 	int v_index = 10;
-	int N = vertices.size();
-	int len = vertices[v_index]->n.size();
 
 	std::ofstream nfp, lfp1;
 	nfp.open("F:\\nfp.txt");
 	lfp1.open("F:\\lfp1.txt");
 
-	vertices[v_index]->update_geo();
-	double H = vertices[v_index]->H;
-	for (int j = 0; j < len; j++) {
-		vertices[v_index]->n[j]->update_geo();
-		vertices[v_index]->n[j]->update_energy(0);
-		H += vertices[v_index]->n[j]->H;
-	}
-	vertices[v_index]->update_energy(0);
+	sm.update_geo();
+	sm.update_energy();
+	double H = sm.get_sum_of_energy();
 
 	vertices[v_index]->make_last();
 	double n_x = vertices[v_index]->n_vec.x;
@@ -634,18 +1697,14 @@ void force_profile(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &
 
 	double H_new;
 
+	// Only the vertex and the elements depending on it are updated after each move.
 	for (double move = -0.02e-6; move < 0.02e-6; move += 0.001e-6) {
 		vertices[v_index]->point->x = vertices[v_index]->point_last->x + n_x*move;
 		vertices[v_index]->point->y = vertices[v_index]->point_last->y + n_y*move;
 		vertices[v_index]->point->z = vertices[v_index]->point_last->z + n_z*move;
-		vertices[v_index]->update_geo();
-		vertices[v_index]->update_energy(0);
-		H_new = 0;
-		H_new = vertices[v_index]->H;
-		for (int j = 0; j < len; j++) {
-			vertices[v_index]->n[j]->update_geo();
-			H_new += vertices[v_index]->n[j]->H;
-		}
+		sm.mark_moved(v_index);
+		sm.update_local();
+		H_new = sm.get_sum_of_energy();
 		//std::cout << "move: " << move << "\tdH: " << H_new - H << std::endl;
 		nfp << move << '\t' << H_new - H << std::endl;
 	}
@@ -654,14 +1713,9 @@ void force_profile(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &
 		vertices[v_index]->point->x = vertices[v_index]->point_last->x + l1_x*move;
 		vertices[v_index]->point->y = vertices[v_index]->point_last->y + l1_y*move;
 		vertices[v_index]->point->z = vertices[v_index]->point_last->z + l1_z*move;
-		vertices[v_index]->update_geo();
-		vertices[v_index]->update_energy(0);
-		H_new = 0;
-		H_new = vertices[v_index]->H;
-		for (int j = 0; j < len; j++) {
-			vertices[v_index]->n[j]->update_geo();
-			H_new += vertices[v_index]->n[j]->H;
-		}
+		sm.mark_moved(v_index);
+		sm.update_local();
+		H_new = sm.get_sum_of_energy();
 		//std::cout << "move: " << move << "\tdH: " << H_new - H << std::endl;
 		lfp1 << move << '\t' << H_new - H << std::endl;
 	}
@@ -669,3 +1723,41 @@ void force_profile(std::vector<MS::vertex*> &vertices, std::vector<MS::facet*> &
 	nfp.close();
 	lfp1.close();
 }
+
+void scaling_benchmark(MS::surface_mesh &sm) {
+	/**************************************************************************
+		This function measures the wall time of geometry and energy updates
+		using 1, 2, 4, ... threads up to the configured number of threads, and
+		reports the speedup compared with a single thread.
+	**************************************************************************/
+	const int repeats = 20;
+	int max_threads = parallel::get_num_threads();
+
+	std::vector<int> thread_counts;
+	for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+	thread_counts.push_back(max_threads);
+
+	std::ofstream scaling_out;
+	scaling_out.open("scaling.SimOut");
+
+	double time_single = 0;
+	for (int t : thread_counts) {
+		parallel::set_num_threads(t);
+		sm.update_geo(); // Warming up
+		sm.update_energy();
+
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; r++) {
+			sm.update_geo();
+			sm.update_energy();
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+		if (t == 1) time_single = elapsed;
+
+		LOG(INFO) << "Threads: " << t << " Time per update: " << elapsed * 1000 << " ms Speedup: " << time_single / elapsed;
+		scaling_out << t << '\t' << elapsed << '\t' << time_single / elapsed << std::endl;
+	}
+
+	scaling_out.close();
+	parallel::set_num_threads(max_threads);
+}
\ No newline at end of file
@@ -1,10 +1,57 @@
 #pragma once
 
+#include<string>
 #include<vector>
 
 #include"surface_mesh.h"
 #include"surface_mesh_tip.h"
 
 namespace MS{
+	enum Minimizer {
+		SteepestDescent,
+		ConjugateGradient, // Polak-Ribiere
+		PreconditionedCG, // Polak-Ribiere with a block-Jacobi preconditioner
+		LBFGS,
+		FIRE, // Fast inertial relaxation engine, without line search
+		NewtonCG // Truncated Newton, with finite difference Hessian-vector products
+	};
+
+	enum LineSearch {
+		BacktrackingLineSearch, // Grows alpha by a linearized force, and shrinks it by a fixed factor
+		WolfeLineSearch // Strong Wolfe conditions, with cubic interpolation
+	};
+
+	struct simulation_settings {
+		Minimizer minimizer = ConjugateGradient;
+		LineSearch line_search = WolfeLineSearch;
+		int lbfgs_history = 8; // Number of most recent correction pairs kept by L-BFGS
+		int pcg_refresh = 5; // The preconditioner of PreconditionedCG is rebuilt every pcg_refresh iterations
+		int newton_max_inner = 50; // Maximum number of Hessian-vector products of each Newton-CG step
+		int fire_max_steps = 100000; // FIRE stops after this many steps even if the force is not small enough
+		int parallel_line_search = 0; // Number of trial alphas evaluated at the same time on copies of the mesh. Less than 2 to disable.
+		double repulsion_cutoff = 0; // Cutoff distance of tip repulsion. Not positive to evaluate all facets.
+		double repulsion_skin = 5e-8; // Skin distance of the neighbor facet list of tips
+		double repulsion_far_ratio = 0; // Distance ratio beyond which facets use the quadrature. Not positive to disable.
+		double repulsion_point_ratio = 0; // Distance ratio beyond which facets use the centroid. Not positive to disable.
+		bool trajectory_single_precision = false; // Write trajectories as float32 instead of float64
+		int output_every = 1; // Only every output_every-th frame of each trajectory is written
+		int output_buffers = 4; // Number of frame buffers of each trajectory waiting to be written
+		bool output_drop_when_full = true; // Drop frames (counted and logged) instead of waiting when all the buffers of a trajectory are full, so the solver never waits for the disk
+	};
+	extern simulation_settings settings;
+
+	// Sets a runtime option given as key=value. Returns false if the key is unknown.
+	bool set_option(const std::string &key, const std::string &value);
+
 	int simulation_start(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips);
-}
\ No newline at end of file
+}
+
+const double max_move = 5e-8; // Maximum displacement for each step in any direction
+
+// Minimizes the energy of the mesh with the tips fixed
+int minimization(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips);
+
+// Line search selected by settings.line_search, or the parallel one if settings.parallel_line_search is at least 2.
+// The evaluations are counted for the log of minimization().
+// alpha_guess: the first trial of alpha. If not positive, it is estimated from the energy.
+double line_search(MS::surface_mesh &sm, std::vector<MS::filament_tip*> &tips, double H, double &H_new, double* p, double d_H_max, double *d_H_new, double m, double &m_new, double alpha0, double alpha_guess = 0);
\ No newline at end of file
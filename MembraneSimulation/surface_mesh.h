@@ -7,16 +7,26 @@ Definition of point and vertex structure, and some common functions associated.
 **********************************************************/
 
 #include<vector>
-#include<map>
 
 #include"common.h"
 #include"math_public.h"
+#include"surface_mesh_grid.h"
+#include"surface_mesh_region.h"
+#include"surface_mesh_state.h"
+#include"surface_mesh_store.h"
+#include"surface_mesh_topology.h"
 
 namespace MS {
 	class vertex;
 	class facet;
 	class edge;
 
+	// How facet::calc_angle() computes the cotangents of the corner angles
+	enum CotangentKernel {
+		TrigCotangent, // cos / sin, with sin = sqrt(1 - cos^2) and the derivatives chained through theta
+		CrossCotangent // dot / |cross|, using the facet area. The angles come from atan2 and need no sqrt.
+	};
+
 	class vertex {
 		/**********************************************************************
 		This is a class which describe a vertex.
@@ -32,56 +42,65 @@ namespace MS {
 
 		vertex(math_public::Vec3 *npoint);
 		~vertex();
-		inline void release_point() { delete point; }
+		inline void release_point() { if (!in_state) delete point; }
+		bool in_state = false; // Whether point, point_last and d_H are views into a mesh_state
 
 		int neighbors;
-		std::map<vertex*, int> neighbor_indices_map;
 		int count_neighbors();
 		int gen_next_prev_n();
 
+		// Half-edge topology. Assigned by half_edge_topology::build(), and the pointers
+		// point into the slice [offset, offset + neighbors) of the topology arrays.
+		int index = -1; // Index of this vertex in the mesh
+		const int *he_next = nullptr, *he_prev = nullptr, *he_twin = nullptr; // Global half-edge indices
+		inline int twin_index(int i)const { return he_twin[i] - n[i]->offset; } // Index of this vertex in n[i]->n
+		int neighbor_index(const vertex *v)const; // Linear search. Only used before the topology is built.
+
 		/******************************
 		Geometry part
 		******************************/
 		// Local properties other than coordinates may also depend on neighbouring points.
+		// The per-neighbor arrays below are not owned by the vertex. They point into the
+		// slice [offset, offset + neighbors) of a geometry_store shared by the whole mesh.
+		int offset = 0; // Index of the first half-edge of this vertex
+		// The angles and distances are gathered from facet::calc_angle() of f[i] and f[i-1].
 		// Theta is the angle between p->n and p->nn
-		std::vector<double> theta, sin_theta;
-		std::vector<math_public::Vec3>d_theta, d_sin_theta, dn_theta, dn_sin_theta, dnn_theta, dnn_sin_theta;
+		double *theta = nullptr, *sin_theta = nullptr;
+		math_public::Vec3 *d_theta = nullptr, *d_sin_theta = nullptr, *dn_theta = nullptr, *dn_sin_theta = nullptr, *dnn_theta = nullptr, *dnn_sin_theta = nullptr;
 		// Theta2 is the angle between np->p and np->n
-		std::vector<double> theta2, cot_theta2;
-		std::vector<math_public::Vec3>d_theta2, d_cot_theta2, dn_theta2, dn_cot_theta2, dnp_theta2, dnp_cot_theta2;
+		double *theta2 = nullptr, *cot_theta2 = nullptr;
+		math_public::Vec3 *d_theta2 = nullptr, *d_cot_theta2 = nullptr, *dn_theta2 = nullptr, *dn_cot_theta2 = nullptr, *dnp_theta2 = nullptr, *dnp_cot_theta2 = nullptr;
 		// Theta3 is the angle between nn->p and nn->n
-		std::vector<double> theta3, cot_theta3;
-		std::vector<math_public::Vec3>d_theta3, d_cot_theta3, dn_theta3, dn_cot_theta3, dnn_theta3, dnn_cot_theta3;
+		double *theta3 = nullptr, *cot_theta3 = nullptr;
+		math_public::Vec3 *d_theta3 = nullptr, *d_cot_theta3 = nullptr, *dn_theta3 = nullptr, *dn_cot_theta3 = nullptr, *dnn_theta3 = nullptr, *dnn_cot_theta3 = nullptr;
 		// Distances
-		std::vector<double> r_p_n;
-		std::vector<math_public::Vec3> d_r_p_n, dn_r_p_n;
-		std::vector<double> r_p_np;
-		std::vector<math_public::Vec3> d_r_p_np, dnp_r_p_np;
-		std::vector<double> r_p_nn;
-		std::vector<math_public::Vec3> d_r_p_nn, dnn_r_p_nn;
+		double *r_p_n = nullptr;
+		math_public::Vec3 *d_r_p_n = nullptr, *dn_r_p_n = nullptr;
+		double *r_p_np = nullptr;
+		math_public::Vec3 *d_r_p_np = nullptr, *dnp_r_p_np = nullptr;
+		double *r_p_nn = nullptr;
+		math_public::Vec3 *d_r_p_nn = nullptr, *dnn_r_p_nn = nullptr;
 
 		double area;
 		math_public::Vec3 d_area;
-		std::vector<math_public::Vec3> dn_area;
+		math_public::Vec3 *dn_area = nullptr;
 		double curv_h;
 		math_public::Vec3 d_curv_h;
-		std::vector<math_public::Vec3> dn_curv_h;
+		math_public::Vec3 *dn_curv_h = nullptr;
 		double curv_g;
 		math_public::Vec3 d_curv_g;
-		std::vector<math_public::Vec3> dn_curv_g;
+		math_public::Vec3 *dn_curv_g = nullptr;
 		
 		math_public::Vec3 n_vec; // Normal vector (pseudo)
 		// We calculate the normal vector using the average of surrounding facet normal vectors.
 		math_public::Mat3 d_n_vec;
-		std::vector<math_public::Mat3> dn_n_vec;
+		math_public::Mat3 *dn_n_vec = nullptr;
 		
 		math_public::Vec3 Div1VecField;
 		math_public::Mat3 d_Div1VecField;
 		double volume_op; // The volume contribution of a vertex using divergence theorem.
 		math_public::Vec3 d_volume_op;
-		std::vector<math_public::Vec3> dn_volume_op;
-
-		int dump_data_vectors(int size=1);
+		math_public::Vec3 *dn_volume_op = nullptr;
 
 		void calc_angle();
 		double calc_area();
@@ -92,10 +111,20 @@ namespace MS {
 
 		void update_geo();
 
+		// Values only, without any derivatives, which are left from the last update_geo().
+		// The values are computed exactly as in the full versions.
+		void calc_angle_value();
+		double calc_area_value();
+		double calc_curv_h_value();
+		void calc_normal_value();
+		double calc_volume_op_value();
+
+		void update_geo_value();
+
 		double area0;
 		math_public::Vec3 *point_last;
 		void make_initial(); // Making the current geometry the initial geometry
-		void make_last(); // Recording some of the geometry as the last time geometry
+		void make_last(); // Recording some of the geometry as the last time geometry. For a whole mesh, use mesh_state::make_last().
 
 
 		/******************************
@@ -113,7 +142,8 @@ namespace MS {
 			d_H_curv_g,
 			d_H_osm,
 			d_H_int;
-		math_public::Vec3 d_H; // Energy derivative on this vertex. in J/m.
+		math_public::Vec3 *d_H; // Energy derivative on this vertex. in J/m. Points to d_H_local unless in a mesh_state.
+		math_public::Vec3 d_H_local;
 
 		void clear_energy();
 
@@ -123,6 +153,9 @@ namespace MS {
 		void calc_H_curv_g();
 		void calc_H_osm(double osm_p);
 		inline void calc_H_int() { H_int = 0; d_H_int.set(0, 0, 0); } // This actually serves as cleaning
+		// Gauss-Newton approximation of the 3x3 block of the Hessian of H_area, H_curv_h and H_osm with
+		// respect to this vertex, from the derivatives of the last update_geo() of this vertex and its neighbors.
+		math_public::Mat3 calc_H_block()const;
 		void inc_d_H_int(const math_public::Vec3 &d);
 		
 		inline void sum_energy() {
@@ -132,10 +165,11 @@ namespace MS {
 			*/
 			// some of d_H_int might come from other sources
 			H = H_area + H_curv_h + H_osm + H_int;
-			d_H = d_H_area + d_H_curv_h + d_H_osm + d_H_int;
+			*d_H = d_H_area + d_H_curv_h + d_H_osm + d_H_int;
 		}
 
 		void update_energy(double osm_p);
+		void update_energy_value(double osm_p); // Energy without derivatives, after update_geo_value()
 
 		/******************************
 		Test
@@ -149,6 +183,7 @@ namespace MS {
 	public:
 		vertex *v[3];
 		edge *e[3];
+		int index = -1; // Index of this facet in the mesh
 
 		/******************************
 		Geometry is mostly calculated in vertex class
@@ -157,9 +192,9 @@ namespace MS {
 
 		facet(vertex *v0, vertex *v1, vertex *v2) {
 			v[0] = v0; v[1] = v1; v[2] = v2;
-			ind[0] = v[0]->neighbor_indices_map[v[1]];
-			ind[1] = v[1]->neighbor_indices_map[v[2]];
-			ind[2] = v[2]->neighbor_indices_map[v[0]];
+			ind[0] = v[0]->neighbor_index(v[1]);
+			ind[1] = v[1]->neighbor_index(v[2]);
+			ind[2] = v[2]->neighbor_index(v[0]);
 		}
 		bool operator==(const facet& operand);
 
@@ -171,6 +206,18 @@ namespace MS {
 		void calc_vec();
 		void calc_normal();
 
+		// Edge lengths and corner angles, shared by the 3 vertices.
+		// Edge j goes from v[j] to v[j+1], and d_r[j] is the derivative with regard to v[j]
+		// (the derivative with regard to v[j+1] is -d_r[j]).
+		// Theta[j] is the angle at v[j], and d_theta[j][k] is its derivative with regard to v[k].
+		double r[3];
+		math_public::Vec3 d_r[3];
+		double theta[3], sin_theta[3], cot_theta[3];
+		math_public::Vec3 d_theta[3][3], d_sin_theta[3][3], d_cot_theta[3][3];
+		static CotangentKernel cot_kernel;
+		void calc_angle(); // With CrossCotangent, needs the area from calc_area_and_projmat()
+		void calc_angle_value();
+
 		// Area and projection matrix
 		double S;
 		math_public::Vec3 d_S[3];
@@ -185,6 +232,7 @@ namespace MS {
 		void calc_area_and_projmat();
 
 		void update_geo();
+		void update_geo_value(); // Only the vectors, the normal vector, the angles and the area, without derivatives
 
 		/******************************
 		Energy part
@@ -210,8 +258,8 @@ namespace MS {
 
 		edge(vertex *v0, vertex *v1) {
 			v[0] = v0, v[1] = v1;
-			ind[0] = v[0]->neighbor_indices_map[v[1]];
-			ind[1] = v[1]->neighbor_indices_map[v[0]];
+			ind[0] = v[0]->neighbor_index(v[1]);
+			ind[1] = v[1]->neighbor_index(v[0]);
 		}
 		bool operator==(const edge& operand);
 
@@ -240,17 +288,46 @@ namespace MS {
 		std::vector<facet*> facets;
 		std::vector<edge*> edges;
 
+		half_edge_topology topo; // Built once after loading the neighbor lists
+		geometry_store geo_store; // Per-neighbor geometry of all the vertices
+		mesh_state state; // Positions and energy derivatives of all the vertices
+		facet_grid grid; // Rebuilt on demand by the users of the grid
+
 		void initialize();
 
-		void update_geo();
+		void update_geo(); // This also clears the moved vertices, because all of them are updated.
+		void update_geo_value(); // Geometry without derivatives. Edges are not updated.
+		unsigned long long geo_version = 0; // Increased by every update_geo(), update_geo_value() or update_local()
 
 		void update_energy(); // This will clear all foreign interactions and derivatives.
-		double get_sum_of_energy();
+		void update_energy_value(); // Energy without derivatives. This will clear all foreign interactions.
+		// The sum is recorded by update_energy() and update_energy_value(), and kept up to date by update_local().
+		inline double get_sum_of_energy()const { return sum_of_energy; }
+
+		// Local updates after moving a few vertices.
+		// Move the points, mark them, and then update_local() updates the geometry, energies and
+		// derivatives of only the elements that depend on the moved vertices, which gives the same
+		// results as update_geo() and update_energy(), except that:
+		//     the foreign interactions (H_int and d_H_int) are kept, and the caller should renew them;
+		//     the sum of energy is changed by the difference, so it might differ in the last digits.
+		// osm_p and area0 must not have been changed since the last full update.
+		dirty_region dirty;
+		inline void mark_moved(int vertex_index) { dirty.mark(vertex_index); }
+		void update_local();
 
 		/************************************
 		Universal variables for the meshwork
 		************************************/
 		double osm_p;
+
+		/******************************
+		Test
+		******************************/
+		static test::TestCase test_case;
+
+	private:
+		double sum_of_energy = 0;
+		void sum_energy_of_vertices(); // Records the sum of the energies of all the vertices
 	};
 
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #define _USE_MATH_DEFINES
 
+#include<algorithm>
 #include<math.h>
 
 #include"common.h"
+#include"parallel.h"
+#include"profiler.h"
 #include"surface_mesh_tip.h"
+#include"surface_mesh_tip_simd.h"
 #include"surface_mesh.h"
 
 using namespace math_public;
@@ -12,7 +16,7 @@ using namespace math_public;
 const double k_c = 1e-19; // Bending modulus
 const double k_g = -2 * k_c; // Saddle-splay modulus
 const double c_0 = 0.0; // Spontaneous curvature
-const double gamma = 0.4; // Surface tension
+const double surface_tension = 0.4; // Surface tension (gamma)
 
 // Use power n=4 for surface repulsive potential
 // @ h0, H = k * h^(-2)
@@ -23,29 +27,32 @@ const double surface_repulsion_k = surface_repulsion_en_0 * surface_repulsion_h0
 
 void MS::vertex::clear_energy() {
 	H = 0;
-	d_H.set(0, 0, 0);
+	d_H->set(0, 0, 0);
 }
 
 void MS::vertex::calc_H_area() {
-	H_area = gamma / 2 / area0 * (area - area0) * (area - area0);
-	d_H_area = gamma / area0 * (area - area0) * d_area;
-	for each(vertex* each_n in n) {
-		d_H_area += gamma / each_n->area0 * (each_n->area - each_n->area0) * each_n->dn_area[each_n->neighbor_indices_map[this]];
+	H_area = surface_tension / 2 / area0 * (area - area0) * (area - area0);
+	d_H_area = surface_tension / area0 * (area - area0) * d_area;
+	for (int i = 0; i < neighbors; i++) {
+		vertex* each_n = n[i];
+		d_H_area += surface_tension / each_n->area0 * (each_n->area - each_n->area0) * each_n->dn_area[twin_index(i)];
 	}
 }
 void MS::vertex::calc_H_curv_h() {
 	H_curv_h = 2 * k_c*(curv_h - c_0)*(curv_h - c_0) * area;
 	d_H_curv_h = 4 * k_c * (curv_h - c_0) * d_curv_h * area + 2 * k_c * (curv_h - c_0) * (curv_h - c_0) * d_area;
-	for each(vertex* each_n in n) {
-		int i = each_n->neighbor_indices_map[this];
+	for (int j = 0; j < neighbors; j++) {
+		vertex* each_n = n[j];
+		int i = twin_index(j);
 		d_H_curv_h += 4 * k_c * (each_n->curv_h - c_0) * each_n->dn_curv_h[i] * each_n->area + 2 * k_c * (each_n->curv_h - c_0) * (each_n->curv_h - c_0) * each_n->dn_area[i];
 	}
 }
 void MS::vertex::calc_H_curv_g() {
 	H_curv_g = k_g * curv_g * area;
 	d_H_curv_g = k_g * (d_curv_g * area + curv_g * d_area);
-	for each(vertex* each_n in n) {
-		int i = each_n->neighbor_indices_map[this];
+	for (int j = 0; j < neighbors; j++) {
+		vertex* each_n = n[j];
+		int i = twin_index(j);
 		d_H_curv_g += k_g * (each_n->dn_curv_g[i] * each_n->area + each_n->curv_g * each_n->dn_area[i]);
 	}
 }
@@ -62,14 +69,27 @@ void MS::vertex::calc_H_osm(double osm_p) {
 	H_osm = osm_p * volume_op;
 	d_H_osm = osm_p * d_volume_op;
 	for (int i = 0; i < neighbors; i++) {
-		int j = n[i]->neighbor_indices_map[this];
+		int j = twin_index(i);
 		d_H_osm += osm_p *n[i]->dn_volume_op[j];
 	}
 	
 }
+Mat3 MS::vertex::calc_H_block()const {
+	// H_area and H_curv_h are sums of squares weighted by positive factors, whose Gauss-Newton
+	// terms are outer products of the derivatives. H_osm is linear in the volume, and the
+	// curvature of the volume itself is left out.
+	Mat3 block = surface_tension / area0 * d_area.tensor(d_area) + 4 * k_c * area * d_curv_h.tensor(d_curv_h);
+	for (int j = 0; j < neighbors; j++) {
+		const vertex* each_n = n[j];
+		int i = twin_index(j);
+		const Vec3 &dn_area_i = each_n->dn_area[i], &dn_curv_h_i = each_n->dn_curv_h[i];
+		block += surface_tension / each_n->area0 * dn_area_i.tensor(dn_area_i) + 4 * k_c * each_n->area * dn_curv_h_i.tensor(dn_curv_h_i);
+	}
+	return block;
+}
 void MS::vertex::inc_d_H_int(const Vec3 &d) {
 	d_H_int += d;
-	d_H += d;
+	*d_H += d;
 }
 
 
@@ -83,12 +103,67 @@ void MS::vertex::update_energy(double osm_p) {
 }
 
 
-void MS::filament_tip::calc_repulsion_facet(MS::facet& f) {
+void MS::vertex::update_energy_value(double osm_p) {
+	// Same as the energies in calc_H_area, calc_H_curv_h, calc_H_osm and calc_H_int
+	H_area = surface_tension / 2 / area0 * (area - area0) * (area - area0);
+	H_curv_h = 2 * k_c*(curv_h - c_0)*(curv_h - c_0) * area;
+	H_osm = osm_p * volume_op;
+	H_int = 0;
+	H = H_area + H_curv_h + H_osm + H_int;
+}
+
+
+double MS::filament_tip::calc_repulsion_facet_value(const MS::facet& f)const {
+	PROFILE_SCOPE_DETAIL("filament_tip::calc_repulsion_facet_value");
+	// Same as calc_repulsion_facet, without derivatives
+	Vec3 r01 = *(f.v[1]->point) - *(f.v[0]->point), r12 = *(f.v[2]->point) - *(f.v[1]->point), rp0 = *(f.v[0]->point) - *point;
+
+	double A = r01.get_norm2();
+	double B = r12.get_norm2();
+	double C = rp0.get_norm2();
+	double D = 2 * dot(r01, rp0);
+	double E = 2 * dot(r12, rp0);
+	double F = 2 * dot(r01, r12);
+
+	double A1 = 2 * A*E - D*F;
+	double A2 = 2 * B*D - 2 * A*E + (D - E)*F;
+	double A3 = -4 * A*B - 2 * B*D + F*(E + F);
+
+	double B1 = 4 * A*C - D*D;
+	double B2 = 4 * A*C - D*D + 4 * B*C - E*E + 4 * C*F - 2 * D*E;
+	double B3 = 4 * B*A - F*F + 4 * B*C - E*E + 4 * B*D - 2 * E*F;
+	double BB1 = sqrt(B1);
+	double BB2 = sqrt(B2);
+	double BB3 = sqrt(B3);
+
+	double C1 = 2 * A + D;
+	double C2 = 2 * A + D + E + 2 * (B + F);
+	double C3 = 2 * B + E + F;
+	double D1 = D;
+	double D2 = D + E;
+	double D3 = E + F;
+
+	double E1 = atan(C1 / BB1);
+	double E2 = atan(C2 / BB2);
+	double E3 = atan(C3 / BB3);
+	double F1 = atan(D1 / BB1);
+	double F2 = atan(D2 / BB2);
+	double F3 = atan(D3 / BB3);
+
+	double G1 = A1 / BB1;
+	double G2 = A2 / BB2;
+	double G3 = A3 / BB3;
+
+	double I_numerator = G1*(E1 - F1) + G2*(E2 - F2) + G3*(E3 - F3);
+	double I_denominator = B*D*D + A*(-4 * B*C + E*E) + F*(-D*E + C*F);
+	double I = I_numerator / I_denominator;
+
+	return surface_repulsion_k * f.S * I;
+}
+void MS::filament_tip::calc_repulsion_facet(const MS::facet& f, double &en, Vec3 *d)const {
+	PROFILE_SCOPE_DETAIL("filament_tip::calc_repulsion_facet");
 	// Calculate interaction energy between the filament tip and a certain facet
 
-	if (is_in_a_plane(*(f.v[0]->point), *(f.v[1]->point), *(f.v[2]->point), *point)) {
-		*point -= f.n_vec*1e-10; // Move into the cell a little bit.
-	}
 	Vec3 r01 = *(f.v[1]->point) - *(f.v[0]->point), r12 = *(f.v[2]->point) - *(f.v[1]->point), rp0 = *(f.v[0]->point) - *point;
 
 	// See notebook starting page 75
@@ -193,39 +268,274 @@ void MS::filament_tip::calc_repulsion_facet(MS::facet& f) {
 
 	// Calculate energy
 	// H = k * |r01 x r12| * I
-	double en = surface_repulsion_k * f.S * I;
-	H += en;
-	d_H += surface_repulsion_k*(d_I[3] * f.S);
+	en = surface_repulsion_k * f.S * I;
+	d[3] = surface_repulsion_k*(d_I[3] * f.S);
 
 	for (int i = 0; i < 3; i++) {
-		f.v[i]->inc_d_H_int(surface_repulsion_k*(f.d_S[i] * I + d_I[i] * f.S));
+		d[i] = surface_repulsion_k*(f.d_S[i] * I + d_I[i] * f.S);
+	}
+
+
+}
+int MS::filament_tip::far_field_level(const MS::facet& f)const {
+	if (far_ratio <= 0 && point_ratio <= 0) return 0;
+	Vec3 c = (*(f.v[0]->point) + *(f.v[1]->point) + *(f.v[2]->point)) / 3;
+	double h2 = 0;
+	for (int j = 0; j < 3; j++) h2 = std::max(h2, (*(f.v[j]->point) - c).get_norm2());
+	double d2 = (c - *point).get_norm2();
+	if (point_ratio > 0 && d2 >= point_ratio * point_ratio * h2) return 2;
+	if (far_ratio > 0 && d2 >= far_ratio * far_ratio * h2) return 1;
+	return 0;
+}
+void MS::filament_tip::calc_repulsion_facet_far(const MS::facet& f, int level, double &en, Vec3 *d, double &err)const {
+	PROFILE_SCOPE_DETAIL("filament_tip::calc_repulsion_facet_far");
+	// The energy is k * S / 2 * <1/r^4>, where <> is the average over the facet.
+	// Level 1 averages 1/r^4 over the edge midpoints, which is exact for quadratic functions,
+	// and level 2 takes 1/r^4 at the centroid.
+	// Both are compared with the second order Taylor expansion about the centroid,
+	//     <g> = g(c) + tr(Hessian(g) * M) / 2, where M = sum(e_j e_j^T) / 12, e_j = v_j - c,
+	// and Hessian(g) = -4 I / r^6 + 24 u u^T / r^8 for g = 1/r^4, u = c - tip.
+	const Vec3 &x0 = *(f.v[0]->point), &x1 = *(f.v[1]->point), &x2 = *(f.v[2]->point);
+	Vec3 c = (x0 + x1 + x2) / 3;
+	Vec3 u = c - *point;
+	double d2 = u.get_norm2();
+	double g_c = 1 / (d2 * d2);
+	double tr_M = 0, uMu = 0;
+	for (int j = 0; j < 3; j++) {
+		Vec3 e = *(f.v[j]->point) - c;
+		tr_M += e.get_norm2();
+		uMu += dot(e, u) * dot(e, u);
+	}
+	double correction = (-4 * g_c / d2 * tr_M + 24 * g_c / (d2 * d2) * uMu) / 12 / 2;
+	double half_kS = surface_repulsion_k * f.S / 2;
+
+	if (level == 2) {
+		en = half_kS * g_c;
+		err = fabs(half_kS * correction);
+		if (!d) return;
+		Vec3 d_g_c = u * (-4 * g_c / d2); // derivative of g at the centroid
+		d[3] = -half_kS * d_g_c;
+		for (int j = 0; j < 3; j++) {
+			d[j] = surface_repulsion_k / 2 * (f.d_S[j] * g_c) + half_kS / 3 * d_g_c;
+		}
+		return;
 	}
 
+	Vec3 m[3] = { (x0 + x1) / 2, (x1 + x2) / 2, (x2 + x0) / 2 }; // m[j] is the midpoint of v[j] and v[j+1]
+	double g[3];
+	Vec3 d_g[3];
+	for (int j = 0; j < 3; j++) {
+		Vec3 r = m[j] - *point;
+		double r2 = r.get_norm2();
+		g[j] = 1 / (r2 * r2);
+		d_g[j] = r * (-4 * g[j] / r2);
+	}
+	double q = (g[0] + g[1] + g[2]) / 3;
+	en = half_kS * q;
+	err = fabs(half_kS * (q - (g_c + correction)));
+	if (!d) return;
+	d[3] = -half_kS / 3 * (d_g[0] + d_g[1] + d_g[2]);
+	for (int j = 0; j < 3; j++) {
+		// v[j] is in the midpoints m[j] and m[j-1]
+		d[j] = surface_repulsion_k / 2 * (f.d_S[j] * q) + half_kS / 6 * (d_g[j] + d_g[(j + 2) % 3]);
+	}
+}
+bool MS::filament_tip::update_neighbor_list(MS::surface_mesh& sm) {
+	PROFILE_SCOPE("filament_tip::update_neighbor_list");
+	int N = sm.vertices.size();
+	double radius = cutoff + skin;
+	bool rebuild = (n_list_mesh != &sm || n_list_radius != radius || n_list_num_facets != sm.facets.size());
+	if (!rebuild) {
+		double max_move2 = skin * skin / 4;
+		rebuild = ((*point - n_list_tip).get_norm2() > max_move2);
+		for (int i = 0; i < N && !rebuild; i++) {
+			rebuild = ((*(sm.vertices[i]->point) - n_list_points[i]).get_norm2() > max_move2);
+		}
+	}
+	if (!rebuild) return false;
+
+	sm.grid.update(sm.facets, radius, sm.geo_version);
+	sm.grid.query(*point, radius, n_list_indices);
+	int n_near = n_list_indices.size();
+	n_facets.resize(n_near);
+	for (int k = 0; k < n_near; k++) {
+		n_facets[k] = sm.facets[n_list_indices[k]];
+	}
+
+	n_list_mesh = &sm;
+	n_list_radius = radius;
+	n_list_num_facets = sm.facets.size();
+	n_list_tip = *point;
+	n_list_points.resize(N);
+	for (int i = 0; i < N; i++) {
+		n_list_points[i] = *(sm.vertices[i]->point);
+	}
+	n_list_builds++;
+	return true;
+}
+int MS::filament_tip::prepare_facets(MS::surface_mesh& sm) {
+	if (cutoff > 0) update_neighbor_list(sm);
+	int n_e = (cutoff > 0 ? n_facets.size() : sm.facets.size());
+
+	// The tip must not lie in the plane of any facet.
+	// All facets see the same tip position, so this is done before evaluating them.
+	for (int k = 0; k < n_e; k++) {
+		const facet& f = eval_facet(sm, k);
+		if (is_in_a_plane(*(f.v[0]->point), *(f.v[1]->point), *(f.v[2]->point), *point)) {
+			*point -= f.n_vec*1e-10; // Move into the cell a little bit.
+		}
+	}
+	return n_e;
+}
+void MS::filament_tip::calc_cutoff_error(const MS::surface_mesh& sm) {
+	if (cutoff <= 0) {
+		H_cutoff_error = 0;
+		return;
+	}
+	double area_skipped = 0;
+	for (int i = 0, n_f = sm.facets.size(); i < n_f; i++) area_skipped += sm.facets[i]->S;
+	for (int k = 0, n_near = n_facets.size(); k < n_near; k++) area_skipped -= n_facets[k]->S;
+	double rc2 = cutoff * cutoff;
+	H_cutoff_error = (area_skipped > 0 ? surface_repulsion_k * area_skipped / (2 * rc2 * rc2) : 0);
+}
+MS::RepulsionKernel MS::filament_tip::kernel = MS::best_repulsion_kernel();
+
+void MS::filament_tip::calc_far_field(const MS::surface_mesh& sm, int n_e, bool derivatives) {
+	exact_facets.clear();
+	H_far_error = 0;
+	n_far_quadrature = n_far_point = 0;
+	if (far_ratio <= 0 && point_ratio <= 0) {
+		for (int k = 0; k < n_e; k++) exact_facets.push_back(k);
+		return;
+	}
+	facet_level.resize(n_e);
+	facet_far_error.resize(n_e);
+	parallel::parallel_for(0, n_e, [this, &sm, derivatives](int k) {
+		const facet& f = eval_facet(sm, k);
+		facet_level[k] = far_field_level(f);
+		if (facet_level[k] > 0) {
+			calc_repulsion_facet_far(f, facet_level[k], facet_H[k], derivatives ? &facet_d_H[4 * k] : nullptr, facet_far_error[k]);
+		}
+	}, 8);
+	for (int k = 0; k < n_e; k++) {
+		switch (facet_level[k]) {
+		case 0: exact_facets.push_back(k); break;
+		case 1: n_far_quadrature++; H_far_error += facet_far_error[k]; break;
+		case 2: n_far_point++; H_far_error += facet_far_error[k]; break;
+		}
+	}
+}
+void MS::filament_tip::calc_repulsion_exact(const MS::surface_mesh& sm, bool derivatives) {
+	int n_exact = exact_facets.size();
+	if (kernel == RepulsionScalar) {
+		parallel::parallel_for(0, n_exact, [this, &sm, derivatives](int i) {
+			int k = exact_facets[i];
+			if (derivatives) calc_repulsion_facet(eval_facet(sm, k), facet_H[k], &facet_d_H[4 * k]);
+			else facet_H[k] = calc_repulsion_facet_value(eval_facet(sm, k));
+		}, 8);
+		return;
+	}
 
+	// The lanes of a batch do not affect each other, so the result of a facet does not
+	// depend on where it is in a batch.
+	const int width = repulsion_batch::width;
+	int n_b = (n_exact + width - 1) / width;
+	parallel::parallel_for(0, n_b, [this, &sm, n_exact, derivatives](int i) {
+		repulsion_batch b;
+		b.set_tip(surface_repulsion_k, *point);
+		int i_begin = i * width, i_end = std::min(n_exact, i_begin + width);
+		for (int j = i_begin; j < i_end; j++) b.load(eval_facet(sm, exact_facets[j]));
+		b.pad();
+		calc_repulsion_batch(kernel, b, derivatives);
+		for (int j = i_begin; j < i_end; j++) {
+			int k = exact_facets[j];
+			b.store(j - i_begin, facet_H[k], derivatives ? &facet_d_H[4 * k] : nullptr);
+		}
+	}, 1);
 }
 void MS::filament_tip::calc_repulsion(MS::surface_mesh& sm) {
+	PROFILE_SCOPE("filament_tip::calc_repulsion");
+	int n_e = prepare_facets(sm);
+
+	facet_H.resize(n_e);
+	facet_d_H.resize(4 * n_e);
+	calc_far_field(sm, n_e, true);
+	calc_repulsion_exact(sm, true);
+
+	// Summing in the order of facets
 	H = 0;
 	d_H.set(0, 0, 0);
-	int n_f = sm.facets.size();
-	for (int i = 0; i < n_f; i++) {
-		calc_repulsion_facet(*(sm.facets[i]));
+	for (int k = 0; k < n_e; k++) {
+		H += facet_H[k];
+		d_H += facet_d_H[4 * k + 3];
+	}
+
+	if (cutoff > 0) {
+		// Only a few facets. They are in ascending order, so every vertex gets its
+		// derivatives in the same order as the gathering below.
+		for (int k = 0; k < n_e; k++) {
+			facet& f = *(n_facets[k]);
+			for (int j = 0; j < 3; j++) {
+				f.v[j]->inc_d_H_int(facet_d_H[4 * k + j]);
+			}
+		}
+	}
+	else {
+		// Each vertex gathers from its own facets, so no two threads write the same vertex.
+		const half_edge_topology& topo = sm.topo;
+		parallel::parallel_for(0, topo.num_vertices, [this, &sm, &topo](int i) {
+			vertex *v = sm.vertices[i];
+			for (int k = topo.facet_offset[i]; k < topo.facet_offset[i + 1]; k++) {
+				v->inc_d_H_int(facet_d_H[4 * topo.incident_facet[k] + topo.incident_corner[k]]);
+			}
+		});
 	}
+
+	calc_cutoff_error(sm);
+}
+void MS::filament_tip::calc_repulsion_value(MS::surface_mesh& sm) {
+	PROFILE_SCOPE("filament_tip::calc_repulsion_value");
+	int n_e = prepare_facets(sm);
+
+	facet_H.resize(n_e);
+	calc_far_field(sm, n_e, false);
+	calc_repulsion_exact(sm, false);
+
+	H = 0;
+	for (int k = 0; k < n_e; k++) {
+		H += facet_H[k];
+	}
+
+	calc_cutoff_error(sm);
 }
 
 
 void MS::surface_mesh::update_energy() {
+	PROFILE_SCOPE("surface_mesh::update_energy");
+	// Energies and derivatives of a vertex only read the geometry of its neighbors.
 	int N;
 	N = vertices.size();
-	for (int i = 0; i < N; i++) {
+	parallel::parallel_for(0, N, [this](int i) {
 		vertices[i]->update_energy(osm_p);
-	}
+	});
+	sum_energy_of_vertices();
+}
+void MS::surface_mesh::update_energy_value() {
+	PROFILE_SCOPE("surface_mesh::update_energy_value");
+	int N;
+	N = vertices.size();
+	parallel::parallel_for(0, N, [this](int i) {
+		vertices[i]->update_energy_value(osm_p);
+	});
+	sum_energy_of_vertices();
 }
-double MS::surface_mesh::get_sum_of_energy() {
+void MS::surface_mesh::sum_energy_of_vertices() {
+	// Summing in the order of vertices
 	double res = 0;
 	int N;
 	N = vertices.size();
 	for (int i = 0; i < N; i++) {
 		res += vertices[i]->H;
 	}
-	return res;
+	sum_of_energy = res;
 }
@@ -1,7 +1,10 @@
 #define _USE_MATH_DEFINES
 
 #include"common.h"
+#include"parallel.h"
+#include"profiler.h"
 #include"surface_mesh.h"
+#include"surface_mesh_scratch.h"
 
 using namespace MS;
 using namespace math_public;
@@ -12,22 +15,27 @@ using namespace math_public;
 vertex::vertex(Vec3 *npoint) {
 	point = npoint;
 	point_last = new Vec3(0,0,0);
+	d_H = &d_H_local;
 }
 
 vertex::~vertex() {
 	// "point" would not be deleted, since the point might be passed to another vertex or shared by another stucture.
 	// "point" has to be manually released before vertex destructs itself.
-	delete point_last;
+	if (!in_state) delete point_last;
 }
 
 int vertex::count_neighbors() {
 	neighbors = n.size();
-	for (int i = 0; i < neighbors; i++) {
-		neighbor_indices_map[n[i]] = i;
-	}
 	return neighbors;
 }
 
+int vertex::neighbor_index(const vertex *v)const {
+	for (int i = 0, len = n.size(); i < len; i++) {
+		if (n[i] == v) return i;
+	}
+	return -1;
+}
+
 int vertex::gen_next_prev_n() {
 	count_neighbors();
 	for (int i = 0; i < neighbors; i++) {
@@ -37,40 +45,6 @@ int vertex::gen_next_prev_n() {
 	return 0;
 }
 
-int vertex::dump_data_vectors(int size) {
-	for (int i = 0; i < size; i++) {
-		// theta
-		theta.push_back(0), sin_theta.push_back(0);
-		d_theta.push_back(Vec3()), dn_theta.push_back(Vec3()), dnn_theta.push_back(Vec3());
-		d_sin_theta.push_back(Vec3()), dn_sin_theta.push_back(Vec3()), dnn_sin_theta.push_back(Vec3());
-		// theta2
-		theta2.push_back(0), cot_theta2.push_back(0);
-		d_theta2.push_back(Vec3()), dn_theta2.push_back(Vec3()), dnp_theta2.push_back(Vec3());
-		d_cot_theta2.push_back(Vec3()), dn_cot_theta2.push_back(Vec3()), dnp_cot_theta2.push_back(Vec3());
-		// theta3
-		theta3.push_back(0), cot_theta3.push_back(0);
-		d_theta3.push_back(Vec3()), dn_theta3.push_back(Vec3()), dnn_theta3.push_back(Vec3());
-		d_cot_theta3.push_back(Vec3()), dn_cot_theta3.push_back(Vec3()), dnn_cot_theta3.push_back(Vec3());
-		// distances
-		r_p_n.push_back(0), d_r_p_n.push_back(Vec3()), dn_r_p_n.push_back(Vec3());
-		r_p_np.push_back(0), d_r_p_np.push_back(Vec3()), dnp_r_p_np.push_back(Vec3());
-		r_p_nn.push_back(0), d_r_p_nn.push_back(Vec3()), dnn_r_p_nn.push_back(Vec3());
-
-		// Derivatives around a vertex
-		dn_area.push_back(Vec3());
-		dn_curv_h.push_back(Vec3());
-		dn_curv_g.push_back(Vec3());
-
-		// normal
-		dn_n_vec.push_back(Mat3());
-
-		// volume integrand
-		dn_volume_op.push_back(Vec3());
-	}
-
-	return 0;
-}
-
 /*
 int MS::vertex::fill_vectors_with_zeroes() {
 	for (int i = 0, len = n.size(); i < len; i++) {
@@ -90,94 +64,63 @@ int MS::vertex::fill_vectors_with_zeroes() {
 
 
 void vertex::calc_angle() {
+	PROFILE_SCOPE_DETAIL("vertex::calc_angle");
+	// The angles and distances are computed in facet::calc_angle(). Here they are only
+	// gathered from the facets around this vertex.
 	for (int i = 0; i < neighbors; i++) {
-		// Distances
-		r_p_n[i] = dist(*point, *(n[i]->point));
-		d_r_p_n[i] = (*point - *(n[i]->point)) / r_p_n[i];
-		dn_r_p_n[i] = (*(n[i]->point) - *point) / r_p_n[i];
-
-		r_p_np[i] = dist(*point, *(np[i]->point));
-		d_r_p_np[i] = (*point - *(np[i]->point)) / r_p_np[i];
-		dnp_r_p_np[i] = (*(np[i]->point) - *point) / r_p_np[i];
-
-		r_p_nn[i] = dist(*point, *(nn[i]->point));
-		d_r_p_nn[i]= (*point - *(nn[i]->point)) / r_p_nn[i];
-		dnn_r_p_nn[i] = (*(nn[i]->point) - *point) / r_p_nn[i];
-
-		// Find theta
-		double inner_product = dot(*(nn[i]->point) - *point, *(n[i]->point) - *point);
-		Vec3 d_inner_product = 2 * (*point) - *(nn[i]->point) - *(n[i]->point);
-		Vec3 dn_inner_product = *(nn[i]->point) - *point;
-		Vec3 dnn_inner_product = *(n[i]->point) - *point;
-
-		double cos_theta = inner_product / (r_p_n[i] * r_p_nn[i]);
-		Vec3 d_cos_theta = (r_p_n[i] * r_p_nn[i] * d_inner_product - inner_product*(r_p_n[i] * d_r_p_nn[i] + d_r_p_n[i] * r_p_nn[i])) / (r_p_n[i] * r_p_n[i] * r_p_nn[i] * r_p_nn[i]);
-		Vec3 dn_cos_theta = (r_p_n[i] * dn_inner_product - inner_product*dn_r_p_n[i]) / (r_p_n[i] * r_p_n[i] * r_p_nn[i]);
-		Vec3 dnn_cos_theta = (r_p_nn[i] * dnn_inner_product - inner_product*dnn_r_p_nn[i]) / (r_p_nn[i] * r_p_nn[i] * r_p_n[i]);
-
-		sin_theta[i] = sqrt(1 - cos_theta*cos_theta);
-		theta[i] = acos(cos_theta);
-		d_theta[i] = -d_cos_theta / sin_theta[i];
-		dn_theta[i] = -dn_cos_theta / sin_theta[i];
-		dnn_theta[i] = -dnn_cos_theta / sin_theta[i];
-		d_sin_theta[i] = cos_theta*d_theta[i];
-		dn_sin_theta[i] = cos_theta*dn_theta[i];
-		dnn_sin_theta[i] = cos_theta*dnn_theta[i];
-
-		// Find theta2
-		double r_n_np = dist(*(n[i]->point), *(np[i]->point)); // derivative with regard to p is 0
-		Vec3 dn_r_n_np = (*(n[i]->point) - *(np[i]->point)) / r_n_np;
-		Vec3 dnp_r_n_np = (*(np[i]->point) - *(n[i]->point)) / r_n_np;
-		double inner_product2 = dot(*(n[i]->point) - *(np[i]->point), *point - *(np[i]->point));
-		Vec3 d_inner_product2 = *(n[i]->point) - *(np[i]->point);
-		Vec3 dn_inner_product2 = *point - *(np[i]->point);
-		Vec3 dnp_inner_product2 = 2 * *(np[i]->point) - *point - *(n[i]->point);
-
-		double cos_theta2 = inner_product2 / (r_p_np[i] * r_n_np);
-		Vec3 d_cos_theta2 = (r_p_np[i] * d_inner_product2 - inner_product2*d_r_p_np[i]) / (r_p_np[i] * r_p_np[i] * r_n_np);
-		Vec3 dn_cos_theta2 = (r_n_np * dn_inner_product2 - inner_product2*dn_r_n_np) / (r_n_np * r_n_np * r_p_np[i]);
-		Vec3 dnp_cos_theta2= (r_p_np[i] * r_n_np * dnp_inner_product2 - inner_product2*(dnp_r_p_np[i] * r_n_np + r_p_np[i] * dnp_r_n_np)) / (r_p_np[i] * r_p_np[i] * r_n_np*r_n_np);
-
-		double sin_theta2 = sqrt(1 - cos_theta2*cos_theta2);
-		theta2[i] = acos(cos_theta2);
-		d_theta2[i] = -d_cos_theta2 / sin_theta2;
-		dn_theta2[i] = -dn_cos_theta2 / sin_theta2;
-		dnp_theta2[i] = -dnp_cos_theta2 / sin_theta2;
-
-		cot_theta2[i] = cos_theta2 / sin_theta2;
-		d_cot_theta2[i] = -d_theta2[i] / (sin_theta2*sin_theta2);
-		dn_cot_theta2[i] = -dn_theta2[i] / (sin_theta2*sin_theta2);
-		dnp_cot_theta2[i] = -dnp_theta2[i] / (sin_theta2*sin_theta2);
-
-		// Find theta3
-		double r_n_nn = dist(*(n[i]->point), *(nn[i]->point)); // derivative with regard to p is 0
-		Vec3 dn_r_n_nn = (*(n[i]->point) - *(nn[i]->point)) / r_n_nn;
-		Vec3 dnn_r_n_nn = (*(nn[i]->point) - *(n[i]->point)) / r_n_nn;
-		double inner_product3 = dot(*(n[i]->point) - *(nn[i]->point), *point - *(nn[i]->point));
-		Vec3 d_inner_product3 = *(n[i]->point) - *(nn[i]->point);
-		Vec3 dn_inner_product3 = *point - *(nn[i]->point);
-		Vec3 dnn_inner_product3 = 2 * *(nn[i]->point) - *point - *(n[i]->point);
-
-		double cos_theta3 = inner_product3 / (r_p_nn[i] * r_n_nn);
-		Vec3 d_cos_theta3 = (r_p_nn[i] * d_inner_product3 - inner_product3*d_r_p_nn[i]) / (r_p_nn[i] * r_p_nn[i] * r_n_nn);
-		Vec3 dn_cos_theta3 = (r_n_nn * dn_inner_product3 - inner_product3*dn_r_n_nn) / (r_n_nn * r_n_nn * r_p_nn[i]);
-		Vec3 dnn_cos_theta3 = (r_p_nn[i] * r_n_nn * dnn_inner_product3 - inner_product3*(dnn_r_p_nn[i] * r_n_nn + r_p_nn[i] * dnn_r_n_nn)) / (r_p_nn[i] * r_p_nn[i] * r_n_nn*r_n_nn);
-
-		double sin_theta3 = sqrt(1 - cos_theta3*cos_theta3);
-		theta3[i] = acos(cos_theta3);
-		d_theta3[i] = -d_cos_theta3 / sin_theta3;
-		dn_theta3[i] = -dn_cos_theta3 / sin_theta3;
-		dnn_theta3[i] = -dnn_cos_theta3 / sin_theta3;
-
-		cot_theta3[i] = cos_theta3 / sin_theta3;
-		d_cot_theta3[i] = -d_theta3[i] / (sin_theta3*sin_theta3);
-		dn_cot_theta3[i] = -dn_theta3[i] / (sin_theta3*sin_theta3);
-		dnn_cot_theta3[i] = -dnn_theta3[i] / (sin_theta3*sin_theta3);
+		const facet *fi = f[i], *fp = f[loop_add(i, -1, neighbors)]; // (p, n, nn) and (p, np, n)
+		int j = 0, jp = 0;
+		while (fi->v[j] != this) j++;
+		while (fp->v[jp] != this) jp++;
+		int j1 = loop_add(j, 1, 3), j2 = loop_add(j, 2, 3), jp1 = loop_add(jp, 1, 3), jp2 = loop_add(jp, 2, 3);
 
+		// Distances
+		r_p_n[i] = fi->r[j];
+		d_r_p_n[i] = fi->d_r[j];
+		dn_r_p_n[i] = -fi->d_r[j];
+
+		r_p_np[i] = fp->r[jp];
+		d_r_p_np[i] = fp->d_r[jp];
+		dnp_r_p_np[i] = -fp->d_r[jp];
+
+		r_p_nn[i] = fi->r[j2];
+		d_r_p_nn[i] = -fi->d_r[j2];
+		dnn_r_p_nn[i] = fi->d_r[j2];
+
+		// Theta is the angle at p in (p, n, nn)
+		theta[i] = fi->theta[j];
+		sin_theta[i] = fi->sin_theta[j];
+		d_theta[i] = fi->d_theta[j][j];
+		dn_theta[i] = fi->d_theta[j][j1];
+		dnn_theta[i] = fi->d_theta[j][j2];
+		d_sin_theta[i] = fi->d_sin_theta[j][j];
+		dn_sin_theta[i] = fi->d_sin_theta[j][j1];
+		dnn_sin_theta[i] = fi->d_sin_theta[j][j2];
+
+		// Theta2 is the angle at np in (p, np, n)
+		theta2[i] = fp->theta[jp1];
+		d_theta2[i] = fp->d_theta[jp1][jp];
+		dn_theta2[i] = fp->d_theta[jp1][jp2];
+		dnp_theta2[i] = fp->d_theta[jp1][jp1];
+		cot_theta2[i] = fp->cot_theta[jp1];
+		d_cot_theta2[i] = fp->d_cot_theta[jp1][jp];
+		dn_cot_theta2[i] = fp->d_cot_theta[jp1][jp2];
+		dnp_cot_theta2[i] = fp->d_cot_theta[jp1][jp1];
+
+		// Theta3 is the angle at nn in (p, n, nn)
+		theta3[i] = fi->theta[j2];
+		d_theta3[i] = fi->d_theta[j2][j];
+		dn_theta3[i] = fi->d_theta[j2][j1];
+		dnn_theta3[i] = fi->d_theta[j2][j2];
+		cot_theta3[i] = fi->cot_theta[j2];
+		d_cot_theta3[i] = fi->d_cot_theta[j2][j];
+		dn_cot_theta3[i] = fi->d_cot_theta[j2][j1];
+		dnn_cot_theta3[i] = fi->d_cot_theta[j2][j2];
 	}
 }
 
 double vertex::calc_area() {
+	PROFILE_SCOPE_DETAIL("vertex::calc_area");
 	/*****************************************************************************
 	Must be used after angles are calculated.
 
@@ -197,7 +140,7 @@ double vertex::calc_area() {
 			area += (cot_theta2[i] + cot_theta3[i])*dis2;
 			d_area += (d_cot_theta2[i] + d_cot_theta3[i])*dis2 + (cot_theta2[i] + cot_theta3[i]) * 2 * r_p_n[i] * d_r_p_n[i];
 			dn_area[i] += (dn_cot_theta2[i] + dn_cot_theta3[i])*dis2 + (cot_theta2[i] + cot_theta3[i]) * 2 * r_p_n[i] * dn_r_p_n[i];
-			int i_n = neighbor_indices_map.at(nn[i]), i_p = neighbor_indices_map.at(np[i]);
+			int i_n = he_next[i] - offset, i_p = he_prev[i] - offset;
 			dn_area[i_n] += (dnn_cot_theta3[i])*dis2;
 			dn_area[i_p] += (dnp_cot_theta2[i])*dis2;
 		}
@@ -213,6 +156,7 @@ double vertex::calc_area() {
 }
 
 double vertex::calc_curv_h() {
+	PROFILE_SCOPE_DETAIL("vertex::calc_curv_h");
 	/*****************************************************************************
 	Must be used after the angles and the area is calculated.
 	This function could also calculate the normalized normal vector.
@@ -226,14 +170,14 @@ double vertex::calc_curv_h() {
 		Vec3 K;
 		Mat3 d_diff(Eye3), dn_diff(-Eye3);
 		Mat3 d_K;
-		std::vector<Mat3> dn_K(neighbors);
+		Mat3 *dn_K = scratch_arena::local().mat3(neighbors);
 		for (int i = 0; i < neighbors; i++) {
 			Vec3 diff = *point - *(n[i]->point);
 			K += (cot_theta2[i] + cot_theta3[i])*diff;
 			d_K += (d_cot_theta2[i] + d_cot_theta3[i]).tensor(diff) + (cot_theta2[i] + cot_theta3[i])*d_diff;
 			dn_K[i] += (dn_cot_theta2[i] + dn_cot_theta3[i]).tensor(diff) + (cot_theta2[i] + cot_theta3[i])*dn_diff;
 
-			int i_n = neighbor_indices_map[nn[i]], i_p = neighbor_indices_map[np[i]];
+			int i_n = he_next[i] - offset, i_p = he_prev[i] - offset;
 			dn_K[i_n] += dnn_cot_theta3[i].tensor(diff);
 			dn_K[i_p] += dnp_cot_theta2[i].tensor(diff);
 		}
@@ -245,11 +189,11 @@ double vertex::calc_curv_h() {
 		}
 		K /= 2 * area;
 
-		K.calc_norm(); // Must be used before using norm
-		curv_h = K.norm / 2;
-		d_curv_h = (d_K*K) / (2 * K.norm);
+		double K_norm = K.get_norm();
+		curv_h = K_norm / 2;
+		d_curv_h = (d_K*K) / (2 * K_norm);
 		for (int i = 0; i < neighbors; i++) {
-			dn_curv_h[i] = (dn_K[i] * K) / (2 * K.norm);
+			dn_curv_h[i] = (dn_K[i] * K) / (2 * K_norm);
 		}
 		//n_vec = K / K.norm; // We no longer calculate normal vector here because it would be very inaccurate when |K| is close to 0.
 
@@ -271,12 +215,12 @@ double vertex::calc_curv_g() {
 	if (USE_VONOROI_CELL) {
 		double a = 2 * M_PI;
 		Vec3 d_a;
-		std::vector<Vec3> dn_a(neighbors);
+		Vec3 *dn_a = scratch_arena::local().vec3(neighbors);
 		for (int i = 0; i < neighbors; i++) {
 			a -= theta[i];
 			d_a -= d_theta[i];
 			dn_a[i] -= dn_theta[i];
-			int i_n = neighbor_indices_map[nn[i]];
+			int i_n = he_next[i] - offset;
 			dn_a[i_n] -= dnn_theta[i];
 		}
 		d_curv_g = (area*d_a - a*d_area) / (area*area);
@@ -291,6 +235,7 @@ double vertex::calc_curv_g() {
 	}
 }
 void vertex::calc_normal() {
+	PROFILE_SCOPE_DETAIL("vertex::calc_normal");
 	/*****************************************************************************
 	This function calculates the normal vector around a vertex using angle weighted pseudo normal method.
 	
@@ -302,11 +247,12 @@ void vertex::calc_normal() {
 	for (int i = 0; i < neighbors; i++) {
 		sum += f[i]->n_vec * theta[i];
 	}
-	n_vec = sum / sum.get_norm();
+	double sum_norm = sum.get_norm();
+	n_vec = sum / sum_norm;
 
 	// determine derivative of "sum"
 	Mat3 d_sum;
-	Mat3 *dn_sum = new Mat3[neighbors];
+	Mat3 *dn_sum = scratch_arena::local().mat3(neighbors);
 	for (int i = 0; i < neighbors; i++) {
 		// Find the index j on the facet which points to the central vertex
 		int j = 0;
@@ -319,16 +265,15 @@ void vertex::calc_normal() {
 		dn_sum[loop_add(i, 1, neighbors)] += f[i]->d_n_vec[loop_add(j, 2, 3)] * theta[i] + dnn_theta[i].tensor(f[i]->n_vec);
 	}
 
-	Mat3 param1 = (Eye3 - n_vec.tensor(n_vec)) / sum.norm;
+	Mat3 param1 = (Eye3 - n_vec.tensor(n_vec)) / sum_norm;
 	d_n_vec = d_sum * param1;
 	for (int i = 0; i < neighbors; i++) {
 		dn_n_vec[i] = dn_sum[i] * param1;
 	}
-
-	delete[] dn_sum;
 }
 
 double vertex::calc_volume_op() {
+	PROFILE_SCOPE_DETAIL("vertex::calc_volume_op");
 	/*****************************************************************************
 	Must be used after
 		- the normal vector at the vertex is calculated
@@ -356,6 +301,79 @@ void vertex::update_geo() {
 	calc_volume_op();
 }
 
+void vertex::calc_angle_value() {
+	for (int i = 0; i < neighbors; i++) {
+		const facet *fi = f[i], *fp = f[loop_add(i, -1, neighbors)];
+		int j = 0, jp = 0;
+		while (fi->v[j] != this) j++;
+		while (fp->v[jp] != this) jp++;
+		int j2 = loop_add(j, 2, 3), jp1 = loop_add(jp, 1, 3);
+
+		r_p_n[i] = fi->r[j];
+		r_p_np[i] = fp->r[jp];
+		r_p_nn[i] = fi->r[j2];
+
+		theta[i] = fi->theta[j];
+		sin_theta[i] = fi->sin_theta[j];
+		theta2[i] = fp->theta[jp1];
+		cot_theta2[i] = fp->cot_theta[jp1];
+		theta3[i] = fi->theta[j2];
+		cot_theta3[i] = fi->cot_theta[j2];
+	}
+}
+double vertex::calc_area_value() {
+	if (USE_VONOROI_CELL) {
+		area = 0;
+		for (int i = 0; i < neighbors; i++) {
+			double dis2 = r_p_n[i] * r_p_n[i];
+			area += (cot_theta2[i] + cot_theta3[i])*dis2;
+		}
+		area /= 8;
+		return area;
+	}
+	else {
+		return 0;
+	}
+}
+double vertex::calc_curv_h_value() {
+	if (USE_VONOROI_CELL) {
+		Vec3 K;
+		for (int i = 0; i < neighbors; i++) {
+			Vec3 diff = *point - *(n[i]->point);
+			K += (cot_theta2[i] + cot_theta3[i])*diff;
+		}
+		K /= 2 * area;
+
+		curv_h = K.get_norm() / 2;
+		return curv_h;
+	}
+	else {
+		return 0;
+	}
+}
+void vertex::calc_normal_value() {
+	Vec3 sum(0, 0, 0);
+	for (int i = 0; i < neighbors; i++) {
+		sum += f[i]->n_vec * theta[i];
+	}
+	n_vec = sum / sum.get_norm();
+}
+double vertex::calc_volume_op_value() {
+	Div1VecField.set(point->x / 3, point->y / 3, point->z / 3);
+	double field_in_normal_dir = dot(Div1VecField, n_vec);
+	volume_op = field_in_normal_dir*area;
+	return volume_op;
+}
+
+void vertex::update_geo_value() {
+	PROFILE_SCOPE_DETAIL("vertex::update_geo_value");
+	calc_angle_value();
+	calc_area_value();
+	calc_curv_h_value();
+	calc_normal_value();
+	calc_volume_op_value();
+}
+
 void vertex::make_initial() {
 	area0 = area;
 }
@@ -370,21 +388,97 @@ void facet::calc_vec() {
 	v1 = *(v[1]->point) - *(v[0]->point);
 	v2 = *(v[2]->point) - *(v[0]->point);
 	r12 = v2 - v1;
-	v1.calc_norm();
-	v2.calc_norm();
-	r12.calc_norm();
 }
 void facet::calc_normal() {
 	Vec3 res = cross(v1, v2);
-	n_vec = res / res.get_norm();
+	double res_norm = res.get_norm();
+	n_vec = res / res_norm;
 	Mat3 d0_res = -r12.to_skew_cross(),
 		d1_res = v2.to_skew_cross(),
 		d2_res = -v1.to_skew_cross(); // Notebook page 68
-	Mat3 temp = (Eye3 - n_vec.tensor(n_vec)) / res.norm;
+	Mat3 temp = (Eye3 - n_vec.tensor(n_vec)) / res_norm;
 	d_n_vec[0] = d0_res*temp;
 	d_n_vec[1] = d1_res*temp;
 	d_n_vec[2] = d2_res*temp;
 }
+CotangentKernel facet::cot_kernel = TrigCotangent;
+
+void facet::calc_angle() {
+	for (int j = 0; j < 3; j++) {
+		const Vec3 &A = *(v[j]->point), &B = *(v[loop_add(j, 1, 3)]->point);
+		r[j] = dist(A, B);
+		d_r[j] = (A - B) / r[j];
+	}
+	for (int a = 0; a < 3; a++) {
+		// Angle at A in triangle (A, B, C)
+		int b = loop_add(a, 1, 3), c = loop_add(a, 2, 3);
+		const Vec3 &A = *(v[a]->point), &B = *(v[b]->point), &C = *(v[c]->point);
+		double r_a_b = r[a], r_a_c = r[c];
+		Vec3 da_r_a_b = d_r[a], db_r_a_b = -d_r[a];
+		Vec3 da_r_a_c = -d_r[c], dc_r_a_c = d_r[c];
+
+		double inner_product = dot(C - A, B - A);
+		Vec3 da_inner_product = 2 * A - C - B;
+		Vec3 db_inner_product = C - A;
+		Vec3 dc_inner_product = B - A;
+
+		double cos_theta = inner_product / (r_a_b * r_a_c);
+		if (cot_kernel == CrossCotangent) {
+			// |(B - A) x (C - A)| is 2S for every corner, so
+			// cot = dot / 2S, and theta = atan2(2S, dot) with dot^2 + (2S)^2 = r_a_b^2 r_a_c^2.
+			double cross_norm = 2 * S;
+			double r2_r2 = r_a_b * r_a_b * r_a_c * r_a_c;
+			Vec3 d_inner_product[3];
+			d_inner_product[a] = da_inner_product; d_inner_product[b] = db_inner_product; d_inner_product[c] = dc_inner_product;
+
+			sin_theta[a] = cross_norm / (r_a_b * r_a_c);
+			theta[a] = atan2(cross_norm, inner_product);
+			cot_theta[a] = inner_product / cross_norm;
+			for (int k = 0; k < 3; k++) {
+				Vec3 d_cross_norm = 2 * d_S[k];
+				d_theta[a][k] = (inner_product * d_cross_norm - cross_norm * d_inner_product[k]) / r2_r2;
+				d_sin_theta[a][k] = cos_theta*d_theta[a][k];
+				d_cot_theta[a][k] = (d_inner_product[k] - cot_theta[a] * d_cross_norm) / cross_norm;
+			}
+			continue;
+		}
+
+		Vec3 d_cos_theta[3];
+		d_cos_theta[a] = (r_a_b * r_a_c * da_inner_product - inner_product*(r_a_b * da_r_a_c + da_r_a_b * r_a_c)) / (r_a_b * r_a_b * r_a_c * r_a_c);
+		d_cos_theta[b] = (r_a_b * db_inner_product - inner_product*db_r_a_b) / (r_a_b * r_a_b * r_a_c);
+		d_cos_theta[c] = (r_a_c * dc_inner_product - inner_product*dc_r_a_c) / (r_a_c * r_a_c * r_a_b);
+
+		sin_theta[a] = sqrt(1 - cos_theta*cos_theta);
+		theta[a] = acos(cos_theta);
+		cot_theta[a] = cos_theta / sin_theta[a];
+		for (int k = 0; k < 3; k++) {
+			d_theta[a][k] = -d_cos_theta[k] / sin_theta[a];
+			d_sin_theta[a][k] = cos_theta*d_theta[a][k];
+			d_cot_theta[a][k] = -d_theta[a][k] / (sin_theta[a] * sin_theta[a]);
+		}
+	}
+}
+void facet::calc_angle_value() {
+	for (int j = 0; j < 3; j++) {
+		r[j] = dist(*(v[j]->point), *(v[loop_add(j, 1, 3)]->point));
+	}
+	for (int a = 0; a < 3; a++) {
+		int b = loop_add(a, 1, 3), c = loop_add(a, 2, 3);
+		const Vec3 &A = *(v[a]->point), &B = *(v[b]->point), &C = *(v[c]->point);
+		double inner_product = dot(C - A, B - A);
+		if (cot_kernel == CrossCotangent) {
+			double cross_norm = 2 * S;
+			sin_theta[a] = cross_norm / (r[a] * r[c]);
+			theta[a] = atan2(cross_norm, inner_product);
+			cot_theta[a] = inner_product / cross_norm;
+			continue;
+		}
+		double cos_theta = inner_product / (r[a] * r[c]);
+		sin_theta[a] = sqrt(1 - cos_theta*cos_theta);
+		theta[a] = acos(cos_theta);
+		cot_theta[a] = cos_theta / sin_theta[a];
+	}
+}
 void facet::calc_area_and_projmat() {
 
 	// Calculate the area of the triangle.
@@ -396,15 +490,16 @@ void facet::calc_area_and_projmat() {
 	// alpha and beta need to satisfy the perpendicular condition
 	// A * (alpha, beta)' = B
 	// So (alpha, beta)' = A^(-1) * B
+	double v1_norm2 = v1.get_norm2();
+	double v2_norm2 = v2.get_norm2();
 	double dot12 = dot(v1, v2);
 	Vec3 d0_dot12 = -v2 - v1, d1_dot12 = v2, d2_dot12 = v1; // Already taken into account those "Eye"-derivatives.
-	Vec3 d0_norm2_v1 = -v1 * 2, d1_norm2_v1 = v1 * 2, d0_norm_v1 = -v1 / v1.norm, d1_norm_v1 = v1 / v1.norm;
-	Vec3 d0_norm2_v2 = -v2 * 2, d2_norm2_v2 = v2 * 2, d0_norm_v2 = -v2 / v2.norm, d2_norm_v2 = v2 / v2.norm;
-	Vec3 d1_norm2_r12 = -r12 * 2, d2_norm2_r12 = r12 * 2, d1_norm_r12 = -r12 / r12.norm, d2_norm_r12 = r12 / r12.norm;
+	Vec3 d0_norm2_v1 = -v1 * 2, d1_norm2_v1 = v1 * 2;
+	Vec3 d0_norm2_v2 = -v2 * 2, d2_norm2_v2 = v2 * 2;
 
-	d_S[0] = (-v1.norm2*v2 - v2.norm2*v1 + dot12*(v1 + v2)) / S / 4;
-	d_S[1] = (v2.norm2*v1 - dot12*v2) / S / 4;
-	d_S[2] = (v1.norm2*v2 - dot12*v1) / S / 4;
+	d_S[0] = (-v1_norm2*v2 - v2_norm2*v1 + dot12*(v1 + v2)) / S / 4;
+	d_S[1] = (v2_norm2*v1 - dot12*v2) / S / 4;
+	d_S[2] = (v1_norm2*v2 - dot12*v1) / S / 4;
 
 	// det(A) = |v1|^2 |v2|^2 - (v1 * v2)^2, but theoretically this is essentially S2^2
 	double det_A = S * S * 4;
@@ -412,24 +507,37 @@ void facet::calc_area_and_projmat() {
 	Vec3 d0_det_A = 8 * S * d_S[0],
 		d1_det_A = 8 * S * d_S[1],
 		d2_det_A = 8 * S * d_S[2];
-	AR11 = v2.norm2 / det_A;
+	AR11 = v2_norm2 / det_A;
 	AR12 = -dot12 / det_A; // AR21 = AR12
-	AR22 = v1.norm2 / det_A;
-	d_AR11[0] = (det_A*d0_norm2_v2 - v2.norm2*d0_det_A) / det_A2;
-	d_AR11[1] = -v2.norm2*d1_det_A / det_A2;
-	d_AR11[2] = (det_A*d2_norm2_v2 - v2.norm2*d2_det_A) / det_A2;
+	AR22 = v1_norm2 / det_A;
+	d_AR11[0] = (det_A*d0_norm2_v2 - v2_norm2*d0_det_A) / det_A2;
+	d_AR11[1] = -v2_norm2*d1_det_A / det_A2;
+	d_AR11[2] = (det_A*d2_norm2_v2 - v2_norm2*d2_det_A) / det_A2;
 	d_AR12[0] = -(det_A*d0_dot12 - dot12*d0_det_A) / det_A2;
 	d_AR12[1] = -(det_A*d1_dot12 - dot12*d1_det_A) / det_A2;
 	d_AR12[2] = -(det_A*d2_dot12 - dot12*d2_det_A) / det_A2;
-	d_AR22[0] = (det_A*d0_norm2_v1 - v1.norm2*d0_det_A) / det_A2;
-	d_AR22[1] = (det_A*d1_norm2_v1 - v1.norm2*d1_det_A) / det_A2;
-	d_AR22[2] = -v1.norm2*d2_det_A / det_A2;
+	d_AR22[0] = (det_A*d0_norm2_v1 - v1_norm2*d0_det_A) / det_A2;
+	d_AR22[1] = (det_A*d1_norm2_v1 - v1_norm2*d1_det_A) / det_A2;
+	d_AR22[2] = -v1_norm2*d2_det_A / det_A2;
 
 }
 void facet::update_geo() {
+	PROFILE_SCOPE_DETAIL("facet::update_geo");
 	calc_vec();
 	calc_normal();
 	calc_area_and_projmat();
+	calc_angle();
+}
+void facet::update_geo_value() {
+	PROFILE_SCOPE_DETAIL("facet::update_geo_value");
+	calc_vec();
+	Vec3 res = cross(v1, v2);
+	n_vec = res / res.get_norm();
+	S = cross(v1, v2).get_norm() / 2;
+	if (S <= 0) {
+		LOG(WARNING) << "Facet area is not positive. S = " << S;
+	}
+	calc_angle_value();
 }
 bool facet::operator==(const facet& operand) {
 	int first_index = 0;
@@ -479,17 +587,35 @@ void MS::edge::update_geo() {
 }
 
 void MS::surface_mesh::update_geo() {
+	PROFILE_SCOPE("surface_mesh::update_geo");
+	// Each phase only reads the results of the previous phases, so elements
+	// within a phase could be updated in parallel.
 	int N;
 	N = facets.size();
-	for (int i = 0; i < N; i++) {
+	parallel::parallel_for(0, N, [this](int i) {
 		facets[i]->update_geo();
-	}
+	});
 	N = vertices.size();
-	for (int i = 0; i < N; i++) {
+	parallel::parallel_for(0, N, [this](int i) {
 		vertices[i]->update_geo();
-	}
+	});
 	N = edges.size();
-	for (int i = 0; i < N; i++) {
+	parallel::parallel_for(0, N, [this](int i) {
 		edges[i]->update_geo();
-	}
+	});
+	geo_version++;
+	dirty.clear();
+}
+void MS::surface_mesh::update_geo_value() {
+	PROFILE_SCOPE("surface_mesh::update_geo_value");
+	int N;
+	N = facets.size();
+	parallel::parallel_for(0, N, [this](int i) {
+		facets[i]->update_geo_value();
+	});
+	N = vertices.size();
+	parallel::parallel_for(0, N, [this](int i) {
+		vertices[i]->update_geo_value();
+	});
+	geo_version++;
 }
@@ -0,0 +1,120 @@
+#include<algorithm>
+#include<math.h>
+
+#include"surface_mesh_grid.h"
+#include"surface_mesh.h"
+
+using namespace MS;
+using namespace math_public;
+
+void facet_grid::update(const std::vector<facet*>& facets, double cell_size, unsigned long long geo_version) {
+	if (built && built_version == geo_version && requested_cell_size == cell_size) return;
+	built = true;
+	built_version = geo_version;
+	requested_cell_size = cell_size;
+
+	int n_f = facets.size();
+	box.resize(6 * n_f);
+	double hi[3];
+	for (int d = 0; d < 3; d++) {
+		lo[d] = INFINITY;
+		hi[d] = -INFINITY;
+	}
+	for (int i = 0; i < n_f; i++) {
+		double *b = &box[6 * i];
+		for (int d = 0; d < 3; d++) {
+			b[d] = INFINITY;
+			b[d + 3] = -INFINITY;
+		}
+		for (int j = 0; j < 3; j++) {
+			const Vec3 &p = *(facets[i]->v[j]->point);
+			double x[3] = { p.x, p.y, p.z };
+			for (int d = 0; d < 3; d++) {
+				if (b[d] > x[d]) b[d] = x[d];
+				if (b[d + 3] < x[d]) b[d + 3] = x[d];
+			}
+		}
+		for (int d = 0; d < 3; d++) {
+			if (lo[d] > b[d]) lo[d] = b[d];
+			if (hi[d] < b[d + 3]) hi[d] = b[d + 3];
+		}
+	}
+	if (n_f == 0) {
+		for (int d = 0; d < 3; d++) lo[d] = hi[d] = 0;
+	}
+
+	// Limit the number of cells to about twice the number of facets
+	double volume = 1;
+	for (int d = 0; d < 3; d++) volume *= std::max(hi[d] - lo[d], cell_size);
+	cell = std::max(cell_size, cbrt(volume / (2.0 * std::max(n_f, 1))));
+	int num_cells = 1;
+	for (int d = 0; d < 3; d++) {
+		dim[d] = (int)floor((hi[d] - lo[d]) / cell) + 1;
+		num_cells *= dim[d];
+	}
+
+	// Count, then fill (CSR)
+	cell_offset.assign(num_cells + 1, 0);
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			for (int c = 0; c < num_cells; c++) cell_offset[c + 1] += cell_offset[c];
+			cell_facet.resize(cell_offset[num_cells]);
+		}
+		for (int i = 0; i < n_f; i++) {
+			const double *b = &box[6 * i];
+			int c0[3], c1[3];
+			for (int d = 0; d < 3; d++) {
+				c0[d] = cell_coord(b[d], d);
+				c1[d] = cell_coord(b[d + 3], d);
+			}
+			for (int cx = c0[0]; cx <= c1[0]; cx++) for (int cy = c0[1]; cy <= c1[1]; cy++) for (int cz = c0[2]; cz <= c1[2]; cz++) {
+				int c = (cx * dim[1] + cy) * dim[2] + cz;
+				if (pass == 0) cell_offset[c + 1]++;
+				else cell_facet[cell_offset[c]++] = i;
+			}
+		}
+	}
+	// Filling has shifted the offsets by one cell
+	for (int c = num_cells; c > 0; c--) cell_offset[c] = cell_offset[c - 1];
+	cell_offset[0] = 0;
+
+	stamp.assign(n_f, 0);
+	cur_stamp = 0;
+}
+
+void facet_grid::query(const Vec3& p, double rc, std::vector<int>& out) {
+	out.clear();
+	if (!built) return;
+
+	if (++cur_stamp == 0) { // Wrapped around
+		std::fill(stamp.begin(), stamp.end(), 0);
+		cur_stamp = 1;
+	}
+
+	double x[3] = { p.x, p.y, p.z };
+	int c0[3], c1[3];
+	for (int d = 0; d < 3; d++) {
+		if (x[d] + rc < lo[d] || x[d] - rc > lo[d] + dim[d] * cell) return; // Out of the grid
+		c0[d] = cell_coord(x[d] - rc, d);
+		c1[d] = cell_coord(x[d] + rc, d);
+	}
+	double rc2 = rc * rc;
+	for (int cx = c0[0]; cx <= c1[0]; cx++) for (int cy = c0[1]; cy <= c1[1]; cy++) for (int cz = c0[2]; cz <= c1[2]; cz++) {
+		int c = (cx * dim[1] + cy) * dim[2] + cz;
+		for (int k = cell_offset[c]; k < cell_offset[c + 1]; k++) {
+			int i = cell_facet[k];
+			if (stamp[i] == cur_stamp) continue;
+			stamp[i] = cur_stamp;
+
+			// Distance from the point to the bounding box
+			const double *b = &box[6 * i];
+			double dist2 = 0;
+			for (int d = 0; d < 3; d++) {
+				double e = (x[d] < b[d] ? b[d] - x[d] : (x[d] > b[d + 3] ? x[d] - b[d + 3] : 0));
+				dist2 += e * e;
+			}
+			if (dist2 <= rc2) out.push_back(i);
+		}
+	}
+	std::sort(out.begin(), out.end());
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+/**********************************************************
+
+Uniform cell grid for finding the facets near a point.
+
+**********************************************************/
+
+#include<vector>
+
+#include"math_public.h"
+
+namespace MS {
+	class facet;
+
+	class facet_grid {
+		/**********************************************************************
+		The axis-aligned bounding box of every facet is registered in all the
+		cells it overlaps. A query with radius rc only visits the cells within
+		rc of the point, and returns the facets whose bounding boxes are within
+		rc, which include all the facets that have any point within rc.
+
+		The grid is built from the facet positions at the time of update(),
+		and is rebuilt only when the geometry version or the cell size changes.
+		**********************************************************************/
+	public:
+		// Rebuilds the grid if necessary. cell_size is the smallest cell edge length allowed.
+		void update(const std::vector<facet*>& facets, double cell_size, unsigned long long geo_version);
+
+		// Indices of facets with bounding box within rc of p, in ascending order.
+		void query(const math_public::Vec3& p, double rc, std::vector<int>& out);
+
+	private:
+		bool built = false;
+		unsigned long long built_version = 0;
+		double requested_cell_size = 0;
+
+		double cell = 0;
+		double lo[3];
+		int dim[3];
+		std::vector<int> cell_offset; // Size (number of cells + 1)
+		std::vector<int> cell_facet;
+		std::vector<double> box; // min x, y, z and max x, y, z of every facet
+
+		std::vector<unsigned int> stamp; // Visiting marks of facets during a query
+		unsigned int cur_stamp = 0;
+
+		inline int cell_coord(double x, int d)const {
+			int c = (int)floor((x - lo[d]) / cell);
+			return c < 0 ? 0 : (c >= dim[d] ? dim[d] - 1 : c);
+		}
+	};
+
+}
@@ -0,0 +1,91 @@
+#include<algorithm>
+
+#include"profiler.h"
+#include"surface_mesh_region.h"
+#include"surface_mesh.h"
+
+using namespace MS;
+
+void dirty_region::mark(int v) {
+	if (v >= (int)moved_stamp.size()) moved_stamp.resize(v + 1, 0);
+	if (moved_stamp[v] == cur_stamp) return;
+	moved_stamp[v] = cur_stamp;
+	moved.push_back(v);
+}
+void dirty_region::expand(const half_edge_topology& topo, int num_facets) {
+	geo_stamp.resize(topo.num_vertices, 0);
+	energy_stamp.resize(topo.num_vertices, 0);
+	facet_stamp.resize(num_facets, 0);
+	facets.clear();
+	geo_vertices.clear();
+	energy_vertices.clear();
+
+	auto add_vertex = [this](std::vector<unsigned int>& stamp, std::vector<int>& list, int v) {
+		if (stamp[v] == cur_stamp) return;
+		stamp[v] = cur_stamp;
+		list.push_back(v);
+	};
+
+	for (int v : moved) {
+		for (int k = topo.facet_offset[v]; k < topo.facet_offset[v + 1]; k++) {
+			int f = topo.incident_facet[k];
+			if (facet_stamp[f] == cur_stamp) continue;
+			facet_stamp[f] = cur_stamp;
+			facets.push_back(f);
+		}
+		add_vertex(geo_stamp, geo_vertices, v);
+		for (int h = topo.offset[v]; h < topo.offset[v + 1]; h++) {
+			add_vertex(geo_stamp, geo_vertices, topo.target[h]);
+		}
+	}
+	for (int v : geo_vertices) {
+		add_vertex(energy_stamp, energy_vertices, v);
+		for (int h = topo.offset[v]; h < topo.offset[v + 1]; h++) {
+			add_vertex(energy_stamp, energy_vertices, topo.target[h]);
+		}
+	}
+}
+void dirty_region::clear() {
+	moved.clear();
+	if (++cur_stamp == 0) { // Wrapped around. Old stamps could be mistaken for new ones.
+		std::fill(moved_stamp.begin(), moved_stamp.end(), 0);
+		std::fill(geo_stamp.begin(), geo_stamp.end(), 0);
+		std::fill(energy_stamp.begin(), energy_stamp.end(), 0);
+		std::fill(facet_stamp.begin(), facet_stamp.end(), 0);
+		cur_stamp = 1;
+	}
+}
+
+void MS::surface_mesh::update_local() {
+	PROFILE_SCOPE("surface_mesh::update_local");
+	if (dirty.empty()) return;
+	dirty.expand(topo, facets.size());
+
+	// Same phases as update_geo() and update_energy(), but only on the dirty region.
+	// The regions are small, so this is done in serial.
+	for (int i : dirty.facets) {
+		facets[i]->update_geo();
+	}
+	for (int i : dirty.geo_vertices) {
+		vertices[i]->update_geo();
+	}
+	for (int i : dirty.facets) {
+		for (int j = 0; j < 3; j++) facets[i]->e[j]->update_geo();
+	}
+	geo_version++;
+
+	// Only the energies of geo_vertices could change. The other vertices only need new derivatives.
+	double d_sum = 0;
+	for (int i : dirty.geo_vertices) d_sum -= vertices[i]->H;
+	for (int i : dirty.energy_vertices) {
+		vertex *v = vertices[i];
+		v->calc_H_area();
+		v->calc_H_curv_h();
+		v->calc_H_osm(osm_p);
+		v->sum_energy(); // Keeps H_int and d_H_int
+	}
+	for (int i : dirty.geo_vertices) d_sum += vertices[i]->H;
+	sum_of_energy += d_sum;
+
+	dirty.clear();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+/**********************************************************
+
+Dirty region of a surface mesh after local vertex moves.
+
+**********************************************************/
+
+#include<vector>
+
+namespace MS {
+	class half_edge_topology;
+
+	class dirty_region {
+		/**********************************************************************
+		Records the vertices moved since the last local update, and expands
+		them to all the elements that read the moved positions:
+			facets: the facets around any moved vertex
+			geo_vertices: the moved vertices and their neighbors (1-ring), whose
+				geometry and energy read the moved positions
+			energy_vertices: geo_vertices and their neighbors (2-ring), whose
+				energy derivatives read the geometry of geo_vertices
+
+		Membership is tested with stamps instead of sets, so nothing is
+		allocated once the arrays have grown to the size of the mesh.
+		**********************************************************************/
+	public:
+		std::vector<int> moved; // Vertex indices, each at most once
+		std::vector<int> facets, geo_vertices, energy_vertices; // Filled by expand(), and kept until the next expand()
+
+		inline bool empty()const { return moved.empty(); }
+		void mark(int v);
+		// Must be used after half_edge_topology::build_incidence().
+		void expand(const half_edge_topology& topo, int num_facets);
+		void clear();
+
+	private:
+		std::vector<unsigned int> moved_stamp, geo_stamp, energy_stamp, facet_stamp;
+		unsigned int cur_stamp = 1;
+	};
+
+}
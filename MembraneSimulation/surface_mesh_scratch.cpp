@@ -0,0 +1,8 @@
+#include"surface_mesh_scratch.h"
+
+using namespace MS;
+
+scratch_arena& scratch_arena::local() {
+	static thread_local scratch_arena arena;
+	return arena;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/**********************************************************
+
+Per-thread scratch buffers for the geometry calculation.
+
+**********************************************************/
+
+#include<algorithm>
+#include<vector>
+
+#include"math_public.h"
+
+namespace MS {
+
+	class scratch_arena {
+		/**********************************************************************
+		Temporary per-neighbor arrays of a vertex are taken from here instead
+		of being allocated on every call.
+
+		Every thread has its own arena. The buffers only grow, so once each
+		thread has handled a vertex with the maximum valence, no memory is
+		allocated any more.
+
+		An array is valid until the next request of the same type on the same
+		thread, so a function must not call anything using the same type of
+		array while holding one.
+		**********************************************************************/
+	public:
+		static scratch_arena& local(); // The arena of the calling thread
+
+		// n zero-initialized elements
+		inline math_public::Mat3* mat3(int n) { return zeroed(mat3_buffer, n); }
+		inline math_public::Vec3* vec3(int n) { return zeroed(vec3_buffer, n); }
+
+	private:
+		std::vector<math_public::Mat3> mat3_buffer;
+		std::vector<math_public::Vec3> vec3_buffer;
+
+		template<typename T>
+		static inline T* zeroed(std::vector<T>& buffer, int n) {
+			if (buffer.size() < (size_t)n) buffer.resize(n);
+			std::fill(buffer.begin(), buffer.begin() + n, T());
+			return buffer.data();
+		}
+	};
+
+}
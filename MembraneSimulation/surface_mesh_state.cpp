@@ -0,0 +1,30 @@
+#include"surface_mesh_state.h"
+#include"surface_mesh.h"
+
+using namespace MS;
+using namespace math_public;
+
+
+void mesh_state::bind(std::vector<vertex*>& vertices) {
+	num_vertices = vertices.size();
+	x.resize(3 * num_vertices);
+	x_last.resize(3 * num_vertices);
+	d_H.resize(3 * num_vertices);
+	d_H_last.resize(3 * num_vertices);
+	p.resize(3 * num_vertices);
+
+	for (int i = 0; i < num_vertices; i++) {
+		vertex *v = vertices[i];
+		*at(x, i) = *(v->point);
+		*at(x_last, i) = *(v->point_last);
+		*at(d_H, i) = *(v->d_H);
+		if (!v->in_state) {
+			delete v->point;
+			delete v->point_last;
+		}
+		v->point = at(x, i);
+		v->point_last = at(x_last, i);
+		v->d_H = at(d_H, i);
+		v->in_state = true;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+/**********************************************************
+
+Flat state vectors of all vertices of a surface mesh.
+
+**********************************************************/
+
+#include<algorithm>
+#include<type_traits>
+#include<vector>
+
+#include"math_public.h"
+
+namespace MS {
+	class vertex;
+
+	class mesh_state {
+		/**********************************************************************
+		The positions, the last positions and the energy derivatives of all
+		vertices are stored as flat arrays of 3N doubles, in the order of the
+		vertex indices, i.e. (x0, y0, z0, x1, y1, z1, ...).
+
+		The point, point_last and d_H of a bound vertex are views into these
+		arrays, so that the minimizer could work on the arrays directly without
+		copying anything from or into the vertices.
+
+		The minimizer also keeps its work arrays here, so that nothing is
+		allocated when it is called again.
+
+		The arrays are allocated once by bind(), and must not be resized
+		afterwards, otherwise the pointers held by the vertices are invalid.
+		**********************************************************************/
+	public:
+		int num_vertices = 0;
+
+		std::vector<double> x; // Positions
+		std::vector<double> x_last; // Positions at the last accepted step
+		std::vector<double> d_H; // Energy derivatives
+		std::vector<double> d_H_last; // Energy derivatives at the last accepted step. Only used by the minimizer.
+		std::vector<double> p; // Search direction of the minimizer
+
+		// Moves the positions of all the vertices into the arrays.
+		void bind(std::vector<vertex*>& vertices);
+
+		inline int size()const { return 3 * num_vertices; }
+		// Records the current positions as the last positions
+		inline void make_last() { std::copy(x.begin(), x.end(), x_last.begin()); }
+
+	private:
+		// Vec3 is viewed as its 3 doubles x, y and z. Strictly this is an aliasing violation, and
+		// it only works as long as Vec3 is a standard layout class of exactly 3 doubles.
+		static_assert(sizeof(math_public::Vec3) == 3 * sizeof(double) && std::is_standard_layout<math_public::Vec3>::value,
+			"Vec3 must be laid out as 3 doubles to be a view into the state arrays.");
+		static inline math_public::Vec3* at(std::vector<double>& a, int i) {
+			return reinterpret_cast<math_public::Vec3*>(a.data() + 3 * i);
+		}
+	};
+
+}
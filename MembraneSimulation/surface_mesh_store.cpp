@@ -0,0 +1,70 @@
+#include"surface_mesh_store.h"
+#include"surface_mesh.h"
+
+using namespace MS;
+using namespace math_public;
+
+void geometry_store::allocate(int n) {
+	num_half_edges = n;
+
+	// theta
+	theta.assign(n, 0); sin_theta.assign(n, 0);
+	d_theta.assign(n, Vec3()); dn_theta.assign(n, Vec3()); dnn_theta.assign(n, Vec3());
+	d_sin_theta.assign(n, Vec3()); dn_sin_theta.assign(n, Vec3()); dnn_sin_theta.assign(n, Vec3());
+	// theta2
+	theta2.assign(n, 0); cot_theta2.assign(n, 0);
+	d_theta2.assign(n, Vec3()); dn_theta2.assign(n, Vec3()); dnp_theta2.assign(n, Vec3());
+	d_cot_theta2.assign(n, Vec3()); dn_cot_theta2.assign(n, Vec3()); dnp_cot_theta2.assign(n, Vec3());
+	// theta3
+	theta3.assign(n, 0); cot_theta3.assign(n, 0);
+	d_theta3.assign(n, Vec3()); dn_theta3.assign(n, Vec3()); dnn_theta3.assign(n, Vec3());
+	d_cot_theta3.assign(n, Vec3()); dn_cot_theta3.assign(n, Vec3()); dnn_cot_theta3.assign(n, Vec3());
+	// distances
+	r_p_n.assign(n, 0); d_r_p_n.assign(n, Vec3()); dn_r_p_n.assign(n, Vec3());
+	r_p_np.assign(n, 0); d_r_p_np.assign(n, Vec3()); dnp_r_p_np.assign(n, Vec3());
+	r_p_nn.assign(n, 0); d_r_p_nn.assign(n, Vec3()); dnn_r_p_nn.assign(n, Vec3());
+
+	// Derivatives around a vertex
+	dn_area.assign(n, Vec3());
+	dn_curv_h.assign(n, Vec3());
+	dn_curv_g.assign(n, Vec3());
+
+	// normal
+	dn_n_vec.assign(n, Mat3());
+
+	// volume integrand
+	dn_volume_op.assign(n, Vec3());
+}
+
+void geometry_store::bind(std::vector<vertex*>& vertices, const half_edge_topology& topo) {
+	int num_vertices = vertices.size();
+
+	allocate(topo.num_half_edges);
+
+	for (int i = 0; i < num_vertices; i++) {
+		vertex *v = vertices[i];
+		int o = topo.offset[i];
+
+		v->theta = theta.data() + o; v->sin_theta = sin_theta.data() + o;
+		v->d_theta = d_theta.data() + o; v->dn_theta = dn_theta.data() + o; v->dnn_theta = dnn_theta.data() + o;
+		v->d_sin_theta = d_sin_theta.data() + o; v->dn_sin_theta = dn_sin_theta.data() + o; v->dnn_sin_theta = dnn_sin_theta.data() + o;
+
+		v->theta2 = theta2.data() + o; v->cot_theta2 = cot_theta2.data() + o;
+		v->d_theta2 = d_theta2.data() + o; v->dn_theta2 = dn_theta2.data() + o; v->dnp_theta2 = dnp_theta2.data() + o;
+		v->d_cot_theta2 = d_cot_theta2.data() + o; v->dn_cot_theta2 = dn_cot_theta2.data() + o; v->dnp_cot_theta2 = dnp_cot_theta2.data() + o;
+
+		v->theta3 = theta3.data() + o; v->cot_theta3 = cot_theta3.data() + o;
+		v->d_theta3 = d_theta3.data() + o; v->dn_theta3 = dn_theta3.data() + o; v->dnn_theta3 = dnn_theta3.data() + o;
+		v->d_cot_theta3 = d_cot_theta3.data() + o; v->dn_cot_theta3 = dn_cot_theta3.data() + o; v->dnn_cot_theta3 = dnn_cot_theta3.data() + o;
+
+		v->r_p_n = r_p_n.data() + o; v->d_r_p_n = d_r_p_n.data() + o; v->dn_r_p_n = dn_r_p_n.data() + o;
+		v->r_p_np = r_p_np.data() + o; v->d_r_p_np = d_r_p_np.data() + o; v->dnp_r_p_np = dnp_r_p_np.data() + o;
+		v->r_p_nn = r_p_nn.data() + o; v->d_r_p_nn = d_r_p_nn.data() + o; v->dnn_r_p_nn = dnn_r_p_nn.data() + o;
+
+		v->dn_area = dn_area.data() + o;
+		v->dn_curv_h = dn_curv_h.data() + o;
+		v->dn_curv_g = dn_curv_g.data() + o;
+		v->dn_n_vec = dn_n_vec.data() + o;
+		v->dn_volume_op = dn_volume_op.data() + o;
+	}
+}
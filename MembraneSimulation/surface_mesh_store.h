@@ -0,0 +1,60 @@
+#pragma once
+
+/**********************************************************
+
+Mesh-wide structure-of-arrays storage for the local geometry.
+
+**********************************************************/
+
+#include<vector>
+
+#include"math_public.h"
+#include"surface_mesh_topology.h"
+
+namespace MS {
+	class vertex;
+
+	class geometry_store {
+		/**********************************************************************
+		All per-neighbor geometry of all vertices lives in contiguous arrays
+		here, instead of in dozens of small vectors owned by every vertex.
+
+		The arrays are indexed by the half-edges of a half_edge_topology. The
+		geometry pointers of a vertex point into these arrays at its offset,
+		so that vertex::theta[i] is exactly theta[vertex::offset + i] here.
+
+		The arrays are allocated once by bind(), and must not be resized
+		afterwards, otherwise the pointers held by the vertices are invalid.
+		**********************************************************************/
+	public:
+		int num_half_edges = 0;
+
+		// Angles (see vertex for definitions)
+		std::vector<double> theta, sin_theta;
+		std::vector<math_public::Vec3> d_theta, d_sin_theta, dn_theta, dn_sin_theta, dnn_theta, dnn_sin_theta;
+		std::vector<double> theta2, cot_theta2;
+		std::vector<math_public::Vec3> d_theta2, d_cot_theta2, dn_theta2, dn_cot_theta2, dnp_theta2, dnp_cot_theta2;
+		std::vector<double> theta3, cot_theta3;
+		std::vector<math_public::Vec3> d_theta3, d_cot_theta3, dn_theta3, dn_cot_theta3, dnn_theta3, dnn_cot_theta3;
+		// Distances
+		std::vector<double> r_p_n;
+		std::vector<math_public::Vec3> d_r_p_n, dn_r_p_n;
+		std::vector<double> r_p_np;
+		std::vector<math_public::Vec3> d_r_p_np, dnp_r_p_np;
+		std::vector<double> r_p_nn;
+		std::vector<math_public::Vec3> d_r_p_nn, dnn_r_p_nn;
+
+		// Derivatives of vertex properties on the neighbors
+		std::vector<math_public::Vec3> dn_area, dn_curv_h, dn_curv_g;
+		std::vector<math_public::Mat3> dn_n_vec;
+		std::vector<math_public::Vec3> dn_volume_op;
+
+		// Allocates the arrays for all the half-edges, and points the geometry
+		// of every vertex into its own slice.
+		void bind(std::vector<vertex*>& vertices, const half_edge_topology& topo);
+
+	private:
+		void allocate(int n);
+	};
+
+}
@@ -1,9 +1,63 @@
 #define _USE_MATH_DEFINES
+#include<array>
+#include<chrono>
+#include<map>
+#include<mutex>
+#include<set>
+#include<thread>
+
+#include"mesh_initialization.h"
+#include"parallel.h"
 #include"surface_mesh.h"
+#include"surface_mesh_scratch.h"
 #include"surface_mesh_tip.h"
 
 using namespace math_public;
 
+namespace {
+	// Builds a closed mesh of radius r from two poles and rings of 6 vertices, so that every
+	// vertex has 6 neighbors. The neighbor lists are found by walking around the triangles.
+	void build_ring_sphere(MS::surface_mesh &sm, int num_rings, double r) {
+		const int M = 6;
+		int N = num_rings * M + 2, north = 0, south = N - 1;
+		auto ring = [&](int k, int j) { return 1 + k * M + (j % M); };
+		sm.vertices.push_back(new MS::vertex(new Vec3(0, 0, r)));
+		for (int k = 0; k < num_rings; k++) {
+			double theta = M_PI * (k + 1) / (num_rings + 1);
+			for (int j = 0; j < M; j++) {
+				double phi = 2 * M_PI * (j + 0.5 * k) / M; // Staggered rings
+				sm.vertices.push_back(new MS::vertex(new Vec3(r * sin(theta) * cos(phi), r * sin(theta) * sin(phi), r * cos(theta))));
+			}
+		}
+		sm.vertices.push_back(new MS::vertex(new Vec3(0, 0, -r)));
+
+		// Triangles counter-clockwise seen from outside
+		std::vector<std::array<int, 3>> triangles;
+		for (int j = 0; j < M; j++) {
+			triangles.push_back({ { north, ring(0, j), ring(0, j + 1) } });
+			triangles.push_back({ { south, ring(num_rings - 1, j + 1), ring(num_rings - 1, j) } });
+			for (int k = 0; k + 1 < num_rings; k++) {
+				triangles.push_back({ { ring(k, j), ring(k + 1, j), ring(k + 1, j + 1) } });
+				triangles.push_back({ { ring(k, j), ring(k + 1, j + 1), ring(k, j + 1) } });
+			}
+		}
+		// next[a][b] is the neighbor of a after b
+		std::vector<std::map<int, int>> next(N);
+		for (auto &t : triangles) {
+			for (int i = 0; i < 3; i++) next[t[i]][t[(i + 1) % 3]] = t[(i + 2) % 3];
+		}
+		for (int i = 0; i < N; i++) {
+			int first = next[i].begin()->first, b = first;
+			do {
+				sm.vertices[i]->n.push_back(sm.vertices[b]);
+				b = next[i][b];
+			} while (b != first);
+			sm.vertices[i]->gen_next_prev_n();
+		}
+		mesh_build(sm);
+	}
+}
+
 test::TestCase MS::vertex::test_case("Vertex Test", []() {
 	test_case.new_step("Initializing");
 	LOG(TEST_DEBUG) << "Generating a hexagonal mesh which includes 7 vertices...";
@@ -16,21 +70,27 @@ test::TestCase MS::vertex::test_case("Vertex Test", []() {
 		vertices.push_back(new vertex(new Vec3(cos(M_PI / 3 * (i-1)), sin(M_PI / 3 * (i-1)), 0)));
 		vertices[0]->n.push_back(vertices[i]);
 		vertices[i]->n.push_back(vertices[0]);
-		vertices[0]->dump_data_vectors();
-		vertices[i]->dump_data_vectors();
+		vertices[i]->gen_next_prev_n();
+	}
+	vertices[0]->gen_next_prev_n();
+
+	half_edge_topology topo;
+	topo.build(vertices);
+	geometry_store store;
+	store.bind(vertices, topo);
+	for (int i = 1; i <= 6; i++) {
 		// Fixing neighbor parameters
 		vertices[i]->area = vertices[i]->area0 = 1.0; // arbitrary number
 		vertices[i]->dn_area[0] = Vec3();
 		vertices[i]->dn_curv_h[0] = Vec3();
 		vertices[i]->dn_curv_g[0] = Vec3();
-		vertices[i]->gen_next_prev_n();
 	}
-	vertices[0]->gen_next_prev_n();
 
 	for (int i = 0; i < 6; i++) {
 		vertices[0]->f.push_back(new facet(vertices[0], vertices[i+1], vertices[loop_add(i, 1, 6)+1]));
 		vertices[0]->f[i]->calc_vec();
 		vertices[0]->f[i]->calc_normal();
+		vertices[0]->f[i]->calc_angle();
 	}
 
 	int N = vertices.size();
@@ -153,6 +213,21 @@ test::TestCase MS::vertex::test_case("Vertex Test", []() {
 	LOG(TEST_DEBUG) << "Normal vector changed: " << del_n_vec.str(1) << " Expected: " << ex_del_n_vec.str(1);
 	test_case.assert_bool(del_n_vec.equal_to(ex_del_n_vec, 1e-3), "Normal vector change incorrect.");
 
+	test_case.new_step("Check values without derivatives");
+	double full_area = vertices[0]->area,
+		full_curv_h = vertices[0]->curv_h,
+		full_volume_op = vertices[0]->volume_op,
+		full_H = vertices[0]->H;
+	Vec3 full_n_vec = vertices[0]->n_vec;
+	for (int i = 0; i < 6; i++) {
+		vertices[0]->f[i]->update_geo_value();
+	}
+	vertices[0]->update_geo_value();
+	vertices[0]->update_energy_value(osm_p);
+	test_case.assert_bool(vertices[0]->area == full_area && vertices[0]->curv_h == full_curv_h && vertices[0]->volume_op == full_volume_op, "Geometry without derivatives is not identical.");
+	test_case.assert_bool(vertices[0]->n_vec.x == full_n_vec.x && vertices[0]->n_vec.y == full_n_vec.y && vertices[0]->n_vec.z == full_n_vec.z, "Normal vector without derivatives is not identical.");
+	test_case.assert_bool(vertices[0]->H == full_H, "Energy without derivatives is not identical.");
+
 	test_case.new_step("Cleaning");
 	for (int i = 0; i < 6; i++) {
 		delete vertices[0]->f[i];
@@ -238,7 +313,10 @@ test::TestCase MS::filament_tip::test_case("Filament Tip Test", []() {
 	f.update_geo();
 
 	surface_mesh sm;
+	sm.vertices = vertices;
 	sm.facets.push_back(&f);
+	sm.topo.build(sm.vertices);
+	sm.topo.build_incidence(sm.facets);
 
 	LOG(TEST_DEBUG) << "Generating a filament tip...";
 	filament_tip ft(new Vec3(0, 0, 0.5e-8));
@@ -255,15 +333,15 @@ test::TestCase MS::filament_tip::test_case("Filament Tip Test", []() {
 	LOG(TEST_DEBUG) << "Interaction energy: " << ft.H;
 	LOG(TEST_DEBUG) << "Energy derivative on tip: " << ft.d_H.str(1);
 	LOG(TEST_DEBUG) << "Energy derivative on vertices: "
-		<< f.v[0]->d_H.str(1) << " "
-		<< f.v[1]->d_H.str(1) << " "
-		<< f.v[2]->d_H.str(1);
+		<< f.v[0]->d_H->str(1) << " "
+		<< f.v[1]->d_H->str(1) << " "
+		<< f.v[2]->d_H->str(1);
 
 	test_case.new_step("Check derivatives");
 	double old_H = ft.H;
 	double diff_H_ex = 0;
 	for (int i = 0; i < 3; i++) {
-		diff_H_ex += f.v[i]->d_H * move[i];
+		diff_H_ex += *(f.v[i]->d_H) * move[i];
 	}
 	diff_H_ex += ft.d_H * movep;
 
@@ -278,10 +356,351 @@ test::TestCase MS::filament_tip::test_case("Filament Tip Test", []() {
 	LOG(TEST_DEBUG) << "Energy difference: " << diff_H << " Expected: " << diff_H_ex;
 	test_case.assert_bool(equal(diff_H, diff_H_ex, 1e-20), "Energy derivative incorrect.");
 
+	test_case.new_step("Check assembly with multiple threads");
+	LOG(TEST_DEBUG) << "Generating a hexagonal mesh which includes 7 vertices and 6 facets...";
+	surface_mesh sm_hex;
+	sm_hex.vertices.push_back(new vertex(new Vec3(0, 0, 0)));
+	for (int i = 1; i <= 6; i++) {
+		sm_hex.vertices.push_back(new vertex(new Vec3(1e-7 * cos(M_PI / 3 * (i - 1)), 1e-7 * sin(M_PI / 3 * (i - 1)), 1e-9 * i)));
+	}
+	for (int i = 0; i < 6; i++) {
+		sm_hex.facets.push_back(new facet(sm_hex.vertices[0], sm_hex.vertices[i + 1], sm_hex.vertices[loop_add(i, 1, 6) + 1]));
+		sm_hex.facets[i]->update_geo();
+	}
+	sm_hex.topo.build(sm_hex.vertices);
+	sm_hex.topo.build_incidence(sm_hex.facets);
+
+	int old_num_threads = parallel::get_num_threads();
+	Vec3 d_H_serial[7], d_H_parallel[7];
+	double H_serial, H_parallel;
+	for (int run = 0; run < 2; run++) {
+		parallel::set_num_threads(run == 0 ? 1 : 4);
+		for (int i = 0; i < 7; i++) {
+			sm_hex.vertices[i]->calc_H_int();
+			sm_hex.vertices[i]->d_H->set(0, 0, 0);
+		}
+		ft.calc_repulsion(sm_hex);
+		(run == 0 ? H_serial : H_parallel) = ft.H;
+		for (int i = 0; i < 7; i++) {
+			(run == 0 ? d_H_serial : d_H_parallel)[i] = *(sm_hex.vertices[i]->d_H);
+		}
+	}
+	parallel::set_num_threads(old_num_threads);
+	bool identical = (H_serial == H_parallel);
+	for (int i = 0; i < 7; i++) {
+		identical = identical && d_H_serial[i].x == d_H_parallel[i].x && d_H_serial[i].y == d_H_parallel[i].y && d_H_serial[i].z == d_H_parallel[i].z;
+	}
+	test_case.assert_bool(identical, "Results with multiple threads are not identical to the serial results.");
+
+	test_case.new_step("Check cutoff");
+	*(ft.point) = Vec3(1.5e-7, 0, 1e-8);
+	double cutoffs[3] = { 0, 1e-6, 0.6e-7 }; // No cutoff, cutoff including all facets, and cutoff skipping some facets
+	double H_cutoff[3];
+	Vec3 d_H_cutoff[3][7];
+	for (int run = 0; run < 3; run++) {
+		ft.cutoff = cutoffs[run];
+		for (int i = 0; i < 7; i++) {
+			sm_hex.vertices[i]->calc_H_int();
+			sm_hex.vertices[i]->d_H->set(0, 0, 0);
+		}
+		ft.calc_repulsion(sm_hex);
+		H_cutoff[run] = ft.H;
+		for (int i = 0; i < 7; i++) {
+			d_H_cutoff[run][i] = *(sm_hex.vertices[i]->d_H);
+		}
+	}
+	LOG(TEST_DEBUG) << "Facets within cutoff: " << ft.n_facets.size() << " Energy: " << H_cutoff[2] << " Exact: " << H_cutoff[0] << " Bound of error: " << ft.H_cutoff_error;
+	identical = (H_cutoff[0] == H_cutoff[1]);
+	for (int i = 0; i < 7; i++) {
+		identical = identical && d_H_cutoff[0][i].x == d_H_cutoff[1][i].x && d_H_cutoff[0][i].y == d_H_cutoff[1][i].y && d_H_cutoff[0][i].z == d_H_cutoff[1][i].z;
+	}
+	test_case.assert_bool(identical, "Results with a cutoff including all facets are not identical to the results without cutoff.");
+	test_case.assert_bool(ft.n_facets.size() > 0 && ft.n_facets.size() < 6, "Cutoff is not skipping the distant facets.");
+	test_case.assert_bool(H_cutoff[0] - H_cutoff[2] >= 0 && H_cutoff[0] - H_cutoff[2] <= ft.H_cutoff_error, "Truncated energy is not within the error bound.");
+
+	test_case.new_step("Check neighbor list");
+	ft.skin = 0.2e-7;
+	ft.calc_repulsion(sm_hex); // Radius changed
+	int n_list_builds = ft.n_list_builds;
+	*(sm_hex.vertices[3]->point) += Vec3(0.09e-7, 0, 0);
+	ft.calc_repulsion(sm_hex);
+	test_case.assert_bool(ft.n_list_builds == n_list_builds, "Neighbor list is rebuilt after a move within half the skin.");
+	*(ft.point) += Vec3(-0.11e-7, 0, 0);
+	ft.calc_repulsion(sm_hex);
+	test_case.assert_bool(ft.n_list_builds == n_list_builds + 1, "Neighbor list is not rebuilt after a move beyond half the skin.");
+	*(sm_hex.vertices[3]->point) -= Vec3(0.09e-7, 0, 0);
+	ft.cutoff = 0;
+	ft.skin = 0;
+
+	test_case.new_step("Check energy without derivatives");
+	for (int run = 0; run < 2; run++) {
+		ft.cutoff = (run == 0 ? 0 : 0.6e-7);
+		ft.calc_repulsion(sm_hex);
+		double full_H = ft.H;
+		ft.calc_repulsion_value(sm_hex);
+		test_case.assert_bool(ft.H == full_H, "Energy without derivatives is not identical.");
+	}
+	ft.cutoff = 0;
+
+	test_case.new_step("Check far field approximations");
+	*(ft.point) = Vec3(0.2e-7, 0.1e-7, 4e-7); // About 7 times the size of the facets
+	double H_far[3], H_far_error[3];
+	Vec3 d_H_far[3][8];
+	for (int run = 0; run < 3; run++) {
+		ft.far_ratio = (run == 1 ? 3 : 0);
+		ft.point_ratio = (run == 2 ? 3 : 0);
+		for (int i = 0; i < 7; i++) {
+			sm_hex.vertices[i]->calc_H_int();
+			sm_hex.vertices[i]->d_H->set(0, 0, 0);
+		}
+		ft.calc_repulsion(sm_hex);
+		H_far[run] = ft.H;
+		H_far_error[run] = ft.H_far_error;
+		for (int i = 0; i < 7; i++) d_H_far[run][i] = *(sm_hex.vertices[i]->d_H);
+		d_H_far[run][7] = ft.d_H;
+		test_case.assert_bool(ft.n_far_quadrature == (run == 1 ? 6 : 0) && ft.n_far_point == (run == 2 ? 6 : 0), "Wrong number of approximated facets.");
+		double full_H = ft.H;
+		ft.calc_repulsion_value(sm_hex);
+		test_case.assert_bool(ft.H == full_H, "Approximated energy without derivatives is not identical.");
+	}
+	double d_H_far_max = 0;
+	for (int i = 0; i < 8; i++) d_H_far_max = std::max(d_H_far_max, d_H_far[0][i].get_norm());
+	for (int run = 1; run < 3; run++) {
+		double actual_error = fabs(H_far[run] - H_far[0]);
+		LOG(TEST_DEBUG) << (run == 1 ? "Quadrature" : "Centroid") << " energy: " << H_far[run] << " Exact: " << H_far[0] << " Estimated error: " << H_far_error[run];
+		test_case.assert_bool(actual_error < 3 * H_far_error[run] && H_far_error[run] < 3 * actual_error, "Estimated error of the far field approximation is off.");
+		double d_H_far_diff = 0;
+		for (int i = 0; i < 8; i++) d_H_far_diff = std::max(d_H_far_diff, (d_H_far[run][i] - d_H_far[0][i]).get_norm());
+		LOG(TEST_DEBUG) << "Largest difference of derivatives: " << d_H_far_diff << " Largest derivative: " << d_H_far_max;
+		test_case.assert_bool(d_H_far_diff < (run == 1 ? 1e-3 : 2e-2) * d_H_far_max, "Derivatives of the far field approximation are off.");
+	}
+	ft.far_ratio = 0;
+	ft.point_ratio = 0;
+
+	test_case.new_step("Check SIMD kernels against the scalar kernel");
+	RepulsionKernel old_kernel = filament_tip::kernel;
+	Vec3 tip_positions[3] = { Vec3(0, 0, 1e-8), Vec3(0.3e-7, -0.2e-7, 0.5e-8), Vec3(1.5e-7, 0, 1e-8) };
+	RepulsionKernel simd_kernels[2] = { RepulsionAVX2, RepulsionAVX512 };
+	for (int run = 0; run < 2; run++) {
+		if (!repulsion_kernel_supported(simd_kernels[run])) {
+			LOG(TEST_DEBUG) << "Kernel " << repulsion_kernel_name(simd_kernels[run]) << " is not supported. Skipped.";
+			continue;
+		}
+		bool simd_equivalent = true;
+		for (int p = 0; p < 3; p++) {
+			*(ft.point) = tip_positions[p];
+			double H_kernel[2];
+			Vec3 d_H_kernel[2][8];
+			for (int kernel_run = 0; kernel_run < 2; kernel_run++) {
+				filament_tip::kernel = (kernel_run == 0 ? RepulsionScalar : simd_kernels[run]);
+				for (int i = 0; i < 7; i++) {
+					sm_hex.vertices[i]->calc_H_int();
+					sm_hex.vertices[i]->d_H->set(0, 0, 0);
+				}
+				ft.calc_repulsion(sm_hex);
+				H_kernel[kernel_run] = ft.H;
+				for (int i = 0; i < 7; i++) d_H_kernel[kernel_run][i] = *(sm_hex.vertices[i]->d_H);
+				d_H_kernel[kernel_run][7] = ft.d_H;
+			}
+			double d_H_max = 0;
+			for (int i = 0; i < 8; i++) d_H_max = std::max(d_H_max, d_H_kernel[0][i].get_norm());
+			simd_equivalent = simd_equivalent && equal(H_kernel[1], H_kernel[0], 1e-12 * fabs(H_kernel[0]));
+			for (int i = 0; i < 8; i++) {
+				simd_equivalent = simd_equivalent && (d_H_kernel[1][i] - d_H_kernel[0][i]).get_norm() <= 1e-10 * d_H_max;
+			}
+			LOG(TEST_DEBUG) << repulsion_kernel_name(simd_kernels[run]) << " energy: " << H_kernel[1] << " Scalar: " << H_kernel[0];
+		}
+		test_case.assert_bool(simd_equivalent, std::string("Results of the ") + repulsion_kernel_name(simd_kernels[run]) + " kernel do not match the scalar kernel.");
+	}
+	filament_tip::kernel = old_kernel;
+
 	test_case.new_step("Cleaning");
 	for (int i = 0; i < N; i++) {
 		vertices[i]->release_point();
 		delete vertices[i];
 	}
+	for (int i = 0; i < 6; i++) {
+		delete sm_hex.facets[i];
+	}
+	for (int i = 0; i < 7; i++) {
+		sm_hex.vertices[i]->release_point();
+		delete sm_hex.vertices[i];
+	}
+
+});
+
+test::TestCase MS::surface_mesh::test_case("Surface Mesh Test", []() {
+	test_case.new_step("Initializing");
+	LOG(TEST_DEBUG) << "Generating an octahedron...";
+	surface_mesh sm;
+	sm.osm_p = 0.02;
+	double r = 1e-7;
+	Vec3 corners[6] = { Vec3(r, 0, 0), Vec3(-r, 0, 0), Vec3(0, r, 0), Vec3(0, -r, 0), Vec3(0, 0, r), Vec3(0, 0, -r) };
+	// Neighbors in counter-clockwise order seen from outside
+	int neighbors[6][4] = { { 2, 4, 3, 5 },{ 2, 5, 3, 4 },{ 4, 0, 5, 1 },{ 4, 1, 5, 0 },{ 0, 2, 1, 3 },{ 0, 3, 1, 2 } };
+	for (int i = 0; i < 6; i++) sm.vertices.push_back(new vertex(new Vec3(corners[i])));
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j < 4; j++) sm.vertices[i]->n.push_back(sm.vertices[neighbors[i][j]]);
+		sm.vertices[i]->gen_next_prev_n();
+	}
+	mesh_build(sm);
+	test_case.assert_bool(sm.facets.size() == 8 && sm.edges.size() == 12, "Octahedron is not built correctly.");
+	sm.initialize();
+	*(sm.vertices[0]->point) += Vec3(0.1e-7, 0.05e-7, 0);
+
+	filament_tip ft(new Vec3(1.3e-7, 0, 0));
+
+	test_case.new_step("Check allocations after warm-up");
+	if (test::allocation_counting_available()) {
+		// Large enough for the loops to be split among the threads
+		surface_mesh sm_sphere;
+		sm_sphere.osm_p = 0.02;
+		build_ring_sphere(sm_sphere, 60, 1e-6);
+		sm_sphere.initialize();
+		filament_tip ft_sphere(new Vec3(1.05e-6, 0, 0));
+		auto update_all = [&]() {
+			sm_sphere.update_geo();
+			sm_sphere.update_energy();
+			ft_sphere.calc_repulsion(sm_sphere);
+			sm_sphere.update_geo_value();
+			sm_sphere.update_energy_value();
+			ft_sphere.calc_repulsion_value(sm_sphere);
+		};
+		int old_num_threads = parallel::get_num_threads();
+		parallel::set_num_threads(4);
+		// The scratch arena of a thread grows the first time it gets work, and a thread might get no
+		// work in the warm-up, so every thread first takes one slow item to grow its arena.
+		int max_neighbors = 0;
+		for (auto each_vertex : sm_sphere.vertices) max_neighbors = std::max(max_neighbors, each_vertex->neighbors);
+		std::set<std::thread::id> warm_threads;
+		std::mutex warm_mutex;
+		for (int tries = 0; tries < 100 && warm_threads.size() < 4; tries++) {
+			parallel::parallel_for(0, 4, [&](int) {
+				scratch_arena::local().mat3(max_neighbors);
+				scratch_arena::local().vec3(max_neighbors);
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				std::lock_guard<std::mutex> lk(warm_mutex);
+				warm_threads.insert(std::this_thread::get_id());
+			}, 1);
+		}
+		for (int i = 0; i < 3; i++) update_all();
+		long long num_allocations = test::get_num_allocations();
+		test::set_allocation_counting(true);
+		for (int i = 0; i < 3; i++) update_all();
+		test::set_allocation_counting(false);
+		num_allocations = test::get_num_allocations() - num_allocations;
+		parallel::set_num_threads(old_num_threads);
+		test_case.assert_bool(sm_sphere.vertices.size() == 362 && sm_sphere.facets.size() == 720, "Sphere is not built correctly.");
+		test_case.assert_bool(warm_threads.size() == 4, "Not every thread got work in the warm-up.");
+		test_case.assert_bool(num_allocations == 0, "Heap allocations in the geometry and energy updates with 4 threads: " + std::to_string(num_allocations));
+		for (auto each_facet : sm_sphere.facets) delete each_facet;
+		for (auto each_edge : sm_sphere.edges) delete each_edge;
+		for (auto each_vertex : sm_sphere.vertices) delete each_vertex;
+		delete ft_sphere.point;
+	}
+	else {
+		LOG(TEST_DEBUG) << "Allocation counting is not linked. Skipped.";
+	}
+
+	test_case.new_step("Check the cross product cotangents against the trigonometric ones");
+	int N = sm.vertices.size();
+	std::vector<double> area[2], curv_h[2], cot[2];
+	std::vector<Vec3> d_H[2];
+	double H[2];
+	for (int run = 0; run < 2; run++) {
+		facet::cot_kernel = (run == 0 ? TrigCotangent : CrossCotangent);
+		sm.update_geo();
+		sm.update_energy();
+		H[run] = sm.get_sum_of_energy();
+		for (int i = 0; i < N; i++) {
+			area[run].push_back(sm.vertices[i]->area);
+			curv_h[run].push_back(sm.vertices[i]->curv_h);
+			d_H[run].push_back(*(sm.vertices[i]->d_H));
+		}
+		for (auto each_facet : sm.facets) {
+			for (int j = 0; j < 3; j++) cot[run].push_back(each_facet->cot_theta[j]);
+		}
+	}
+	facet::cot_kernel = TrigCotangent;
+	double d_H_max = 0;
+	for (int i = 0; i < N; i++) d_H_max = std::max(d_H_max, d_H[0][i].get_norm());
+	bool cot_equivalent = equal(H[1], H[0], 1e-10 * fabs(H[0]));
+	for (int i = 0; i < N; i++) {
+		cot_equivalent = cot_equivalent && equal(area[1][i], area[0][i], 1e-10 * area[0][i]) && equal(curv_h[1][i], curv_h[0][i], 1e-10 * fabs(curv_h[0][i]));
+		Vec3 diff = d_H[1][i] - d_H[0][i];
+		cot_equivalent = cot_equivalent && diff.get_norm() <= 1e-10 * d_H_max;
+	}
+	for (size_t i = 0; i < cot[0].size(); i++) {
+		cot_equivalent = cot_equivalent && equal(cot[1][i], cot[0][i], 1e-10 * (1 + fabs(cot[0][i])));
+	}
+	test_case.assert_bool(cot_equivalent, "Cotangents from cross products do not match the trigonometric ones.");
+
+	test_case.new_step("Check local updates against full updates");
+	sm.update_geo();
+	sm.update_energy();
+	*(sm.vertices[2]->point) += Vec3(-0.03e-7, 0.02e-7, 0.04e-7);
+	sm.mark_moved(2);
+	sm.mark_moved(2); // Marking twice is allowed
+	sm.update_local();
+	test_case.assert_bool(sm.dirty.facets.size() == 4 && sm.dirty.geo_vertices.size() == 5 && sm.dirty.energy_vertices.size() == 6, "Dirty region is incorrect.");
+	std::vector<double> local_H, local_area, local_S;
+	std::vector<Vec3> local_d_H;
+	for (auto each_vertex : sm.vertices) {
+		local_H.push_back(each_vertex->H);
+		local_area.push_back(each_vertex->area);
+		local_d_H.push_back(*(each_vertex->d_H));
+	}
+	for (auto each_facet : sm.facets) local_S.push_back(each_facet->S);
+	double local_sum = sm.get_sum_of_energy();
+	sm.update_geo();
+	sm.update_energy();
+	bool local_identical = equal(local_sum, sm.get_sum_of_energy(), 1e-12 * fabs(local_sum));
+	for (int i = 0; i < N; i++) {
+		const vertex &v = *(sm.vertices[i]);
+		local_identical = local_identical && local_H[i] == v.H && local_area[i] == v.area
+			&& local_d_H[i].x == v.d_H->x && local_d_H[i].y == v.d_H->y && local_d_H[i].z == v.d_H->z;
+	}
+	for (size_t i = 0; i < sm.facets.size(); i++) {
+		local_identical = local_identical && local_S[i] == sm.facets[i]->S;
+	}
+	test_case.assert_bool(local_identical, "Local updates are not identical to full updates.");
+
+	test_case.new_step("Check Hessian blocks");
+	sm.update_geo();
+	sm.update_energy();
+	bool blocks_valid = true;
+	for (int i = 0; i < N; i++) {
+		Mat3 block = sm.vertices[i]->calc_H_block();
+		double scale = block.x.x + block.y.y + block.z.z;
+		// Symmetric, and positive semidefinite by the leading principal minors
+		blocks_valid = blocks_valid && scale > 0
+			&& equal(block.x.y, block.y.x, 1e-12 * scale) && equal(block.x.z, block.z.x, 1e-12 * scale) && equal(block.y.z, block.z.y, 1e-12 * scale)
+			&& block.x.x >= 0 && block.x.x * block.y.y - block.x.y * block.y.x >= -1e-12 * scale * scale
+			&& dot(block.x, cross(block.y, block.z)) >= -1e-12 * scale * scale * scale;
+	}
+	test_case.assert_bool(blocks_valid, "Hessian blocks are not symmetric positive semidefinite.");
+
+	test_case.new_step("Check mesh copies");
+	surface_mesh sm_copy;
+	mesh_copy(sm, sm_copy);
+	sm.update_geo();
+	sm.update_energy();
+	sm_copy.update_geo();
+	sm_copy.update_energy();
+	bool copy_identical = sm_copy.vertices.size() == sm.vertices.size() && sm_copy.facets.size() == sm.facets.size()
+		&& sm_copy.get_sum_of_energy() == sm.get_sum_of_energy() && sm_copy.state.d_H == sm.state.d_H;
+	test_case.assert_bool(copy_identical, "Copied mesh does not have the same energy and derivatives.");
+	*(sm_copy.vertices[1]->point) += Vec3(0.02e-7, 0, 0);
+	sm_copy.update_geo();
+	test_case.assert_bool(sm.vertices[1]->point->x == -r && sm.vertices[1]->area != sm_copy.vertices[1]->area, "Copied mesh is not independent.");
+	for (auto each_facet : sm_copy.facets) delete each_facet;
+	for (auto each_edge : sm_copy.edges) delete each_edge;
+	for (auto each_vertex : sm_copy.vertices) delete each_vertex;
+
+	test_case.new_step("Cleaning");
+	for (auto each_facet : sm.facets) delete each_facet;
+	for (auto each_edge : sm.edges) delete each_edge;
+	for (auto each_vertex : sm.vertices) delete each_vertex;
+	delete ft.point;
 
 });
@@ -7,13 +7,14 @@
 
 #include"math_public.h"
 #include"surface_mesh.h"
+#include"surface_mesh_tip_simd.h"
 
 namespace MS {
 
 	class filament_tip {
 	public:
 		math_public::Vec3 *point;
-		std::vector<facet*> n_facets; // neighbor facet list
+		std::vector<facet*> n_facets; // neighbor facet list, in ascending order of facet index
 
 		filament_tip(math_public::Vec3 *np) :point(np) {}
 
@@ -22,8 +23,62 @@ namespace MS {
 		******************************/
 		double H;
 		math_public::Vec3 d_H; // derivative of energy on THIS tip. Other derivatives go to vertices.
-		void calc_repulsion_facet(facet& f);
+
+		// Energy with a single facet, and its derivatives on f.v[0], f.v[1], f.v[2] and the tip (in d[0..3]).
+		// Nothing is written outside the outputs, so that facets could be evaluated in parallel.
+		void calc_repulsion_facet(const facet& f, double &en, math_public::Vec3 *d)const;
+		double calc_repulsion_facet_value(const facet& f)const; // Energy only
+		// Vertices gather the derivatives from their incident facets, in the order of facet indices.
+		// The mesh topology (including facet incidence) must have been built.
 		void calc_repulsion(surface_mesh& sm);
+		// Energy only, for probing. No derivative is changed, neither on the tip nor on vertices.
+		void calc_repulsion_value(surface_mesh& sm);
+
+		// Kernel used by calc_repulsion() and calc_repulsion_value(). The SIMD kernels evaluate batches
+		// of facets at once, and agree with calc_repulsion_facet() to about 1e-15 relative.
+		// The default is the best kernel supported by the CPU.
+		static RepulsionKernel kernel;
+
+		// Contribution of every facet, kept so that they could be summed in a fixed order.
+		std::vector<double> facet_H;
+		std::vector<math_public::Vec3> facet_d_H; // 4 per facet, same as the d in calc_repulsion_facet
+
+		// Facets farther than the cutoff from the tip are skipped. Not positive to evaluate all facets.
+		double cutoff = 0;
+		// Upper bound of the energy of the skipped facets. Every point of a skipped facet
+		// is farther than the cutoff, so the facet energy is at most k * S / (2 * cutoff^4).
+		double H_cutoff_error = 0;
+
+		/******************************
+		Far field
+		******************************/
+		// Facets whose centroid is farther from the tip than far_ratio times the size of the facet
+		// (the largest distance from the centroid to a vertex) use a 3-point quadrature of the
+		// integral, and those farther than point_ratio times the size use the centroid only.
+		// Not positive to disable either approximation. The ratios should be well above 1.
+		double far_ratio = 0;
+		double point_ratio = 0;
+		// Estimated error of the approximated energy, and the number of approximated facets
+		double H_far_error = 0;
+		int n_far_quadrature = 0, n_far_point = 0;
+
+		// 0 for the exact integral, 1 for the quadrature, 2 for the centroid
+		int far_field_level(const facet& f)const;
+		// Same outputs as calc_repulsion_facet, with the approximation of the level. d may be null.
+		// err is an estimate of the absolute error of en.
+		void calc_repulsion_facet_far(const facet& f, int level, double &en, math_public::Vec3 *d, double &err)const;
+
+		/******************************
+		Neighbor list
+		******************************/
+		// With cutoff, n_facets holds the facets within (cutoff + skin), found using the grid
+		// of the mesh. The list is kept until the tip or any vertex has moved more than half
+		// the skin since the list was built, so that no facet outside the list could come
+		// within the cutoff.
+		double skin = 0;
+		int n_list_builds = 0; // Number of times the list is built
+		bool update_neighbor_list(surface_mesh& sm); // Returns true if the list is rebuilt
+		inline void clear_neighbor_list() { n_list_mesh = nullptr; }
 
 
 		/******************************
@@ -31,6 +86,28 @@ namespace MS {
 		******************************/
 		static test::TestCase test_case;
 
+	private:
+		// Facets to be evaluated are n_facets with cutoff, or all the facets without cutoff.
+		// Returns the number of facets to be evaluated, after moving the tip out of their planes.
+		int prepare_facets(surface_mesh& sm);
+		inline const facet& eval_facet(const surface_mesh& sm, int k)const { return cutoff > 0 ? *n_facets[k] : *sm.facets[k]; }
+		// Evaluates the approximated facets, and lists the others in exact_facets
+		void calc_far_field(const surface_mesh& sm, int n_e, bool derivatives);
+		// Evaluates the facets in exact_facets with the kernel
+		void calc_repulsion_exact(const surface_mesh& sm, bool derivatives);
+		void calc_cutoff_error(const surface_mesh& sm);
+
+		std::vector<int> exact_facets; // Indices of the facets evaluated exactly
+		std::vector<int> facet_level;
+		std::vector<double> facet_far_error;
+
+		// State when the neighbor list is built
+		const surface_mesh *n_list_mesh = nullptr;
+		double n_list_radius = 0;
+		size_t n_list_num_facets = 0;
+		math_public::Vec3 n_list_tip;
+		std::vector<math_public::Vec3> n_list_points;
+		std::vector<int> n_list_indices;
 
 	};
 
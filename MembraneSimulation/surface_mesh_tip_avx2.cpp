@@ -0,0 +1,59 @@
+/*
+	AVX2 kernel of the tip-facet repulsion, 4 facets per instruction.
+	This file is compiled with AVX2 enabled, and the kernel must only be called
+	after repulsion_kernel_supported(RepulsionAVX2) returns true.
+*/
+
+#include"surface_mesh_tip_simd.h"
+
+#if defined(__AVX2__) || (defined(_MSC_VER) && defined(_M_X64))
+
+#include<immintrin.h>
+
+#include"surface_mesh_tip_simd_kernel.h"
+
+namespace {
+	struct vec4d {
+		__m256d v;
+		vec4d() :v(_mm256_setzero_pd()) {}
+		vec4d(double a) :v(_mm256_set1_pd(a)) {}
+		vec4d(__m256d a) :v(a) {}
+	};
+	struct mask4d {
+		__m256d m;
+	};
+
+	inline vec4d operator+(const vec4d &a, const vec4d &b) { return _mm256_add_pd(a.v, b.v); }
+	inline vec4d operator-(const vec4d &a, const vec4d &b) { return _mm256_sub_pd(a.v, b.v); }
+	inline vec4d operator*(const vec4d &a, const vec4d &b) { return _mm256_mul_pd(a.v, b.v); }
+	inline vec4d operator/(const vec4d &a, const vec4d &b) { return _mm256_div_pd(a.v, b.v); }
+	inline vec4d operator-(const vec4d &a) { return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0)); }
+
+	inline vec4d load_pack(const double *p, vec4d) { return _mm256_loadu_pd(p); }
+	inline void store_pack(const vec4d &a, double *p) { _mm256_storeu_pd(p, a.v); }
+	inline vec4d sqrt_of(const vec4d &a) { return _mm256_sqrt_pd(a.v); }
+	inline vec4d abs_of(const vec4d &a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+	inline vec4d copysign_of(const vec4d &mag, const vec4d &sign) {
+		__m256d sign_bit = _mm256_set1_pd(-0.0);
+		return _mm256_or_pd(_mm256_andnot_pd(sign_bit, mag.v), _mm256_and_pd(sign_bit, sign.v));
+	}
+	inline mask4d greater_than(const vec4d &a, const vec4d &b) { return mask4d{ _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ) }; }
+	inline vec4d select(const mask4d &m, const vec4d &a, const vec4d &b) { return _mm256_blendv_pd(b.v, a.v, m.m); }
+}
+
+const bool MS::repulsion_avx2_compiled = true;
+
+void MS::calc_repulsion_batch_avx2(repulsion_batch &b, bool derivatives) {
+	for (int lane0 = 0; lane0 < repulsion_batch::width; lane0 += 4) {
+		if (derivatives) simd_kernel::repulsion<vec4d, true>(b, lane0);
+		else simd_kernel::repulsion<vec4d, false>(b, lane0);
+	}
+}
+
+#else
+
+const bool MS::repulsion_avx2_compiled = false;
+
+void MS::calc_repulsion_batch_avx2(repulsion_batch &, bool) {}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+	AVX-512 kernel of the tip-facet repulsion, 8 facets per instruction.
+	This file is compiled with AVX-512F enabled, and the kernel must only be called
+	after repulsion_kernel_supported(RepulsionAVX512) returns true.
+*/
+
+#include"surface_mesh_tip_simd.h"
+
+#if defined(__AVX512F__) || (defined(_MSC_VER) && defined(_M_X64))
+
+#include<immintrin.h>
+
+#include"surface_mesh_tip_simd_kernel.h"
+
+namespace {
+	struct vec8d {
+		__m512d v;
+		vec8d() :v(_mm512_setzero_pd()) {}
+		vec8d(double a) :v(_mm512_set1_pd(a)) {}
+		vec8d(__m512d a) :v(a) {}
+	};
+	struct mask8d {
+		__mmask8 m;
+	};
+
+	// AVX-512F has no floating point bitwise operations, so the sign bits are handled as integers.
+	// The unmasked forms of the bitwise operations and of sqrt take an undefined source for the
+	// masked-off lanes, which GCC reports as uninitialized, so the masked forms are used with all
+	// lanes set and a defined source.
+	const __mmask8 all_lanes = 0xFF;
+	inline __m512i bits(const vec8d &a) { return _mm512_castpd_si512(a.v); }
+	inline vec8d from_bits(__m512i a) { return _mm512_castsi512_pd(a); }
+	inline __m512i sign_bit() { return _mm512_set1_epi64((long long)0x8000000000000000ULL); }
+	inline __m512i and_of(__m512i a, __m512i b) { return _mm512_mask_and_epi64(a, all_lanes, a, b); }
+	inline __m512i andnot_of(__m512i a, __m512i b) { return _mm512_mask_andnot_epi64(b, all_lanes, a, b); }
+	inline __m512i or_of(__m512i a, __m512i b) { return _mm512_mask_or_epi64(a, all_lanes, a, b); }
+	inline __m512i xor_of(__m512i a, __m512i b) { return _mm512_mask_xor_epi64(a, all_lanes, a, b); }
+
+	inline vec8d operator+(const vec8d &a, const vec8d &b) { return _mm512_add_pd(a.v, b.v); }
+	inline vec8d operator-(const vec8d &a, const vec8d &b) { return _mm512_sub_pd(a.v, b.v); }
+	inline vec8d operator*(const vec8d &a, const vec8d &b) { return _mm512_mul_pd(a.v, b.v); }
+	inline vec8d operator/(const vec8d &a, const vec8d &b) { return _mm512_div_pd(a.v, b.v); }
+	inline vec8d operator-(const vec8d &a) { return from_bits(xor_of(bits(a), sign_bit())); }
+
+	inline vec8d load_pack(const double *p, vec8d) { return _mm512_loadu_pd(p); }
+	inline void store_pack(const vec8d &a, double *p) { _mm512_storeu_pd(p, a.v); }
+	inline vec8d sqrt_of(const vec8d &a) { return _mm512_mask_sqrt_pd(a.v, all_lanes, a.v); }
+	inline vec8d abs_of(const vec8d &a) { return from_bits(andnot_of(sign_bit(), bits(a))); }
+	inline vec8d copysign_of(const vec8d &mag, const vec8d &sign) {
+		return from_bits(or_of(andnot_of(sign_bit(), bits(mag)), and_of(sign_bit(), bits(sign))));
+	}
+	inline mask8d greater_than(const vec8d &a, const vec8d &b) { return mask8d{ _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ) }; }
+	inline vec8d select(const mask8d &m, const vec8d &a, const vec8d &b) { return _mm512_mask_blend_pd(m.m, b.v, a.v); }
+}
+
+const bool MS::repulsion_avx512_compiled = true;
+
+void MS::calc_repulsion_batch_avx512(repulsion_batch &b, bool derivatives) {
+	if (derivatives) simd_kernel::repulsion<vec8d, true>(b, 0);
+	else simd_kernel::repulsion<vec8d, false>(b, 0);
+}
+
+#else
+
+const bool MS::repulsion_avx512_compiled = false;
+
+void MS::calc_repulsion_batch_avx512(repulsion_batch &, bool) {}
+
+#endif
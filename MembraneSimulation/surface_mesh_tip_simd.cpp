@@ -0,0 +1,93 @@
+#include"surface_mesh_tip_simd.h"
+#include"surface_mesh.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  include<intrin.h>
+#endif
+
+using namespace MS;
+using namespace math_public;
+
+void repulsion_batch::set_tip(double nk, const Vec3 &tip) {
+	k = nk;
+	p[0] = tip.x; p[1] = tip.y; p[2] = tip.z;
+}
+void repulsion_batch::load(const facet &f) {
+	int lane = size++;
+	for (int j = 0; j < 3; j++) {
+		const Vec3 &v = *(f.v[j]->point);
+		x[j][0][lane] = v.x; x[j][1][lane] = v.y; x[j][2][lane] = v.z;
+		d_S[j][0][lane] = f.d_S[j].x; d_S[j][1][lane] = f.d_S[j].y; d_S[j][2][lane] = f.d_S[j].z;
+	}
+	S[lane] = f.S;
+}
+void repulsion_batch::pad() {
+	for (int lane = size; lane < width; lane++) {
+		for (int j = 0; j < 3; j++) {
+			for (int c = 0; c < 3; c++) {
+				x[j][c][lane] = x[j][c][0];
+				d_S[j][c][lane] = d_S[j][c][0];
+			}
+		}
+		S[lane] = S[0];
+	}
+}
+void repulsion_batch::store(int lane, double &en_out, Vec3 *d_out)const {
+	en_out = en[lane];
+	if (!d_out) return;
+	for (int j = 0; j < 4; j++) {
+		d_out[j].set(d[j][0][lane], d[j][1][lane], d[j][2][lane]);
+	}
+}
+
+namespace {
+	// Whether the CPU and the operating system support the instruction set
+	bool cpu_supports(RepulsionKernel kernel) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27))) return false; // OSXSAVE
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		if (kernel == RepulsionAVX2) return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5));
+		if (kernel == RepulsionAVX512) return (xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16));
+		return false;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		if (kernel == RepulsionAVX2) return __builtin_cpu_supports("avx2");
+		if (kernel == RepulsionAVX512) return __builtin_cpu_supports("avx512f");
+		return false;
+#else
+		return false;
+#endif
+	}
+}
+
+bool MS::repulsion_kernel_supported(RepulsionKernel kernel) {
+	switch (kernel) {
+	case RepulsionScalar: return true;
+	case RepulsionAVX2: return repulsion_avx2_compiled && cpu_supports(RepulsionAVX2);
+	case RepulsionAVX512: return repulsion_avx512_compiled && cpu_supports(RepulsionAVX512);
+	}
+	return false;
+}
+RepulsionKernel MS::best_repulsion_kernel() {
+	if (repulsion_kernel_supported(RepulsionAVX512)) return RepulsionAVX512;
+	if (repulsion_kernel_supported(RepulsionAVX2)) return RepulsionAVX2;
+	return RepulsionScalar;
+}
+const char* MS::repulsion_kernel_name(RepulsionKernel kernel) {
+	switch (kernel) {
+	case RepulsionScalar: return "scalar";
+	case RepulsionAVX2: return "avx2";
+	case RepulsionAVX512: return "avx512";
+	}
+	return "unknown";
+}
+
+void MS::calc_repulsion_batch(RepulsionKernel kernel, repulsion_batch &b, bool derivatives) {
+	if (kernel == RepulsionAVX512) calc_repulsion_batch_avx512(b, derivatives);
+	else calc_repulsion_batch_avx2(b, derivatives);
+}
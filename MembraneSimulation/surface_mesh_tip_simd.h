@@ -0,0 +1,60 @@
+#pragma once
+
+/**********************************************************
+
+Batched tip-facet repulsion using SIMD instructions.
+
+**********************************************************/
+
+#include"math_public.h"
+
+namespace MS {
+	class facet;
+
+	enum RepulsionKernel {
+		RepulsionScalar, // filament_tip::calc_repulsion_facet(), one facet at a time
+		RepulsionAVX2, // 4 facets per instruction
+		RepulsionAVX512 // 8 facets per instruction
+	};
+
+	struct repulsion_batch {
+		/**********************************************************************
+		Up to 8 facets and one tip, in structure-of-arrays layout, so that a
+		SIMD kernel could load the same quantity of consecutive facets with a
+		single instruction. The unused lanes are filled with copies of the
+		first facet by pad(), and their results are ignored.
+		**********************************************************************/
+		static const int width = 8;
+		int size = 0; // Number of facets loaded
+
+		double k; // Coefficient of the potential
+		double p[3]; // Position of the tip
+		double x[3][3][width]; // x[j][c][lane] is the coordinate c of v[j] of the facet
+		double S[width];
+		double d_S[3][3][width];
+
+		// Results. d[j] is the derivative on v[j], and d[3] is the derivative on the tip.
+		double en[width];
+		double d[4][3][width];
+
+		void set_tip(double nk, const math_public::Vec3 &tip);
+		void load(const facet &f); // Appends the facet as the next lane
+		void pad();
+		void store(int lane, double &en_out, math_public::Vec3 *d_out)const;
+		inline void clear() { size = 0; }
+	};
+
+	bool repulsion_kernel_supported(RepulsionKernel kernel); // By both the compiler and the CPU
+	RepulsionKernel best_repulsion_kernel();
+	const char* repulsion_kernel_name(RepulsionKernel kernel);
+
+	// Evaluates all the lanes of a padded batch. The kernel must be supported and must not be RepulsionScalar.
+	void calc_repulsion_batch(RepulsionKernel kernel, repulsion_batch &b, bool derivatives);
+
+	// Implemented in their own files, which are compiled with the instruction sets.
+	// The flags tell whether the kernels are compiled at all.
+	extern const bool repulsion_avx2_compiled, repulsion_avx512_compiled;
+	void calc_repulsion_batch_avx2(repulsion_batch &b, bool derivatives);
+	void calc_repulsion_batch_avx512(repulsion_batch &b, bool derivatives);
+
+}
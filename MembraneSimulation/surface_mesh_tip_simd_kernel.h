@@ -0,0 +1,184 @@
+#pragma once
+
+/**********************************************************
+
+The tip-facet repulsion on packs of facets.
+
+Only included by the files of the SIMD kernels. The pack type V must be
+constructible from a double, support + - * / and unary -, and have the
+overloads load_pack(), store_pack(), sqrt_of(), abs_of(), copysign_of(),
+greater_than() and select(). V must be declared in an anonymous namespace, so
+that the instantiations compiled with different instruction sets never get
+mixed up by the linker.
+
+The operations are the same and in the same order as in
+filament_tip::calc_repulsion_facet(), so only atan_cephes() makes any
+difference from the scalar results.
+
+**********************************************************/
+
+#include"surface_mesh_tip_simd.h"
+
+namespace MS {
+	namespace simd_kernel {
+
+		template<typename V> struct pack3 {
+			V x, y, z;
+			pack3() :x(0.0), y(0.0), z(0.0) {}
+			pack3(const V &nx, const V &ny, const V &nz) :x(nx), y(ny), z(nz) {}
+		};
+		template<typename V> inline pack3<V> operator+(const pack3<V> &a, const pack3<V> &b) { return pack3<V>(a.x + b.x, a.y + b.y, a.z + b.z); }
+		template<typename V> inline pack3<V> operator-(const pack3<V> &a, const pack3<V> &b) { return pack3<V>(a.x - b.x, a.y - b.y, a.z - b.z); }
+		template<typename V> inline pack3<V> operator-(const pack3<V> &a) { return pack3<V>(-a.x, -a.y, -a.z); }
+		template<typename V> inline pack3<V> operator*(const pack3<V> &a, const V &s) { return pack3<V>(a.x * s, a.y * s, a.z * s); }
+		template<typename V> inline pack3<V> operator*(const V &s, const pack3<V> &a) { return a * s; }
+		template<typename V> inline pack3<V> operator/(const pack3<V> &a, const V &s) { return pack3<V>(a.x / s, a.y / s, a.z / s); }
+		template<typename V> inline V dot(const pack3<V> &a, const pack3<V> &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+		template<typename V> inline pack3<V> load_pack3(const double (&src)[3][repulsion_batch::width], int lane0) {
+			return pack3<V>(load_pack(src[0] + lane0, V()), load_pack(src[1] + lane0, V()), load_pack(src[2] + lane0, V()));
+		}
+		template<typename V> inline void store_pack3(const pack3<V> &a, double (&dst)[3][repulsion_batch::width], int lane0) {
+			store_pack(a.x, dst[0] + lane0);
+			store_pack(a.y, dst[1] + lane0);
+			store_pack(a.z, dst[2] + lane0);
+		}
+
+		// Arctangent from the Cephes library, accurate to about 1 ulp. The branches of the
+		// argument reduction are computed on all lanes, and selected afterwards.
+		template<typename V> inline V atan_cephes(const V &x) {
+			const double P[5] = { -8.750608600031904122785e-1, -1.615753718733365076637e1, -7.500855792314704667340e1, -1.228866684490136173410e2, -6.485021904942025371773e1 };
+			const double Q[5] = { 2.485846490142306297962e1, 1.650270098316988542046e2, 4.328810604912902668951e2, 4.853903996359136964868e2, 1.945506571482613964425e2 };
+			const double T3P8 = 2.41421356237309504880; // tan(3 pi / 8)
+			const double MOREBITS = 6.123233995736765886130e-17; // Low bits of pi / 2
+			const double PIO2 = 1.57079632679489661923, PIO4 = 7.85398163397448309616e-1;
+			const V zero(0.0), one(1.0);
+
+			V ax = abs_of(x);
+			auto big = greater_than(ax, V(T3P8));
+			auto mid = greater_than(ax, V(0.66));
+			V xr = select(big, -(one / ax), select(mid, (ax - one) / (ax + one), ax));
+			V y = select(big, V(PIO2), select(mid, V(PIO4), zero));
+			V more = select(big, V(MOREBITS), select(mid, V(0.5 * MOREBITS), zero));
+
+			V z = xr * xr;
+			V p = V(P[0]);
+			for (int i = 1; i < 5; i++) p = p * z + V(P[i]);
+			V q = z + V(Q[0]);
+			for (int i = 1; i < 5; i++) q = q * z + V(Q[i]);
+			z = z * p / q;
+			z = xr * z + xr;
+			z = z + more;
+			return copysign_of(y + z, x);
+		}
+
+		// Evaluates the lanes [lane0, lane0 + width of V) of the batch
+		template<typename V, bool derivatives>
+		void repulsion(repulsion_batch &b, int lane0) {
+			typedef pack3<V> P;
+			const V two(2.0), four(4.0), one(1.0);
+
+			P x0 = load_pack3<V>(b.x[0], lane0), x1 = load_pack3<V>(b.x[1], lane0), x2 = load_pack3<V>(b.x[2], lane0);
+			P tip(V(b.p[0]), V(b.p[1]), V(b.p[2]));
+			V S = load_pack(b.S + lane0, V());
+
+			P r01 = x1 - x0, r12 = x2 - x1, rp0 = x0 - tip;
+
+			V A = dot(r01, r01);
+			V B = dot(r12, r12);
+			V C = dot(rp0, rp0);
+			V D = two * dot(r01, rp0);
+			V E = two * dot(r12, rp0);
+			V F = two * dot(r01, r12);
+
+			V A1 = two * A*E - D*F;
+			V A2 = two * B*D - two * A*E + (D - E)*F;
+			V A3 = -four * A*B - two * B*D + F*(E + F);
+
+			V B1 = four * A*C - D*D;
+			V B2 = four * A*C - D*D + four * B*C - E*E + four * C*F - two * D*E;
+			V B3 = four * B*A - F*F + four * B*C - E*E + four * B*D - two * E*F;
+			V BB1 = sqrt_of(B1);
+			V BB2 = sqrt_of(B2);
+			V BB3 = sqrt_of(B3);
+
+			V C1 = two * A + D;
+			V C2 = two * A + D + E + two * (B + F);
+			V C3 = two * B + E + F;
+			V D1 = D;
+			V D2 = D + E;
+			V D3 = E + F;
+
+			V E1 = atan_cephes(C1 / BB1);
+			V E2 = atan_cephes(C2 / BB2);
+			V E3 = atan_cephes(C3 / BB3);
+			V F1 = atan_cephes(D1 / BB1);
+			V F2 = atan_cephes(D2 / BB2);
+			V F3 = atan_cephes(D3 / BB3);
+
+			V G1 = A1 / BB1;
+			V G2 = A2 / BB2;
+			V G3 = A3 / BB3;
+
+			V I_numerator = G1*(E1 - F1) + G2*(E2 - F2) + G3*(E3 - F3);
+			V I_denominator = B*D*D + A*(-four * B*C + E*E) + F*(-D*E + C*F);
+			V I = I_numerator / I_denominator;
+
+			const V k(b.k);
+			store_pack(k * S * I, b.en + lane0);
+			if (!derivatives) return;
+
+			// Derivative subscript is 0,1,2,p
+			P d_A[4] = { -two * r01, two * r01, P(), P() };
+			P d_B[4] = { P(), -two * r12, two * r12, P() };
+			P d_C[4] = { two * rp0, P(), P(), -two * rp0 };
+			P d_D[4] = { two * (-rp0 + r01), two * rp0, P(), -two * r01 };
+			P d_E[4] = { two * r12, -two * rp0, two * rp0, -two * r12 };
+			P d_F[4] = { -two * r12, two * (r12 - r01), two * r01, P() };
+
+			P d_I[4];
+			for (int i = 0; i < 4; i++) {
+				P d_A1 = two * (d_A[i] * E + A*d_E[i]) - (d_D[i] * F + D*d_F[i]);
+				P d_A2 = two * (d_B[i] * D + B*d_D[i]) - two * (d_A[i] * E + A*d_E[i]) + ((d_D[i] - d_E[i])*F + (D - E)*d_F[i]);
+				P d_A3 = -four * (d_A[i] * B + A*d_B[i]) - two * (d_B[i] * D + B*d_D[i]) + (d_F[i] * (E + F) + F*(d_E[i] + d_F[i]));
+
+				P d_B1 = four * (d_A[i] * C + A*d_C[i]) - two * D*d_D[i];
+				P d_B2 = four * (d_A[i] * C + A*d_C[i]) - two * D*d_D[i] + four * (d_B[i] * C + B*d_C[i]) - two * E*d_E[i] + four * (d_C[i] * F + C*d_F[i]) - two * (d_D[i] * E + D*d_E[i]);
+				P d_B3 = four * (d_B[i] * A + B*d_A[i]) - two * F*d_F[i] + four * (d_B[i] * C + B*d_C[i]) - two * E*d_E[i] + four * (d_B[i] * D + B*d_D[i]) - two * (d_E[i] * F + E*d_F[i]);
+				P d_BB1 = d_B1 / two / BB1;
+				P d_BB2 = d_B2 / two / BB2;
+				P d_BB3 = d_B3 / two / BB3;
+
+				P d_C1 = two * d_A[i] + d_D[i];
+				P d_C2 = two * d_A[i] + d_D[i] + d_E[i] + two * (d_B[i] + d_F[i]);
+				P d_C3 = two * d_B[i] + d_E[i] + d_F[i];
+				P d_D1 = d_D[i];
+				P d_D2 = d_D[i] + d_E[i];
+				P d_D3 = d_E[i] + d_F[i];
+
+				P d_E1 = one / (one + (C1 / BB1)*(C1 / BB1)) * (BB1*d_C1 - C1*d_BB1) / B1;
+				P d_E2 = one / (one + (C2 / BB2)*(C2 / BB2)) * (BB2*d_C2 - C2*d_BB2) / B2;
+				P d_E3 = one / (one + (C3 / BB3)*(C3 / BB3)) * (BB3*d_C3 - C3*d_BB3) / B3;
+				P d_F1 = one / (one + (D1 / BB1)*(D1 / BB1)) * (BB1*d_D1 - D1*d_BB1) / B1;
+				P d_F2 = one / (one + (D2 / BB2)*(D2 / BB2)) * (BB2*d_D2 - D2*d_BB2) / B2;
+				P d_F3 = one / (one + (D3 / BB3)*(D3 / BB3)) * (BB3*d_D3 - D3*d_BB3) / B3;
+
+				P d_G1 = (BB1*d_A1 - A1*d_BB1) / B1;
+				P d_G2 = (BB2*d_A2 - A2*d_BB2) / B2;
+				P d_G3 = (BB3*d_A3 - A3*d_BB3) / B3;
+
+				P d_I_numerator = d_G1 * (E1 - F1) + G1*(d_E1 - d_F1) + d_G2 * (E2 - F2) + G2*(d_E2 - d_F2) + d_G3 * (E3 - F3) + G3*(d_E3 - d_F3);
+				P d_I_denominator = d_B[i] * D*D + B * two * D*d_D[i] + d_A[i] * (-four * B*C + E*E) + A*(-four * (d_B[i] * C + B*d_C[i]) + two * E*d_E[i]) + d_F[i] * (-D*E + C*F) + F*(-(d_D[i] * E + D*d_E[i]) + d_C[i] * F + C*d_F[i]);
+
+				d_I[i] = (I_denominator*d_I_numerator - I_numerator*d_I_denominator) / (I_denominator*I_denominator);
+			}
+
+			store_pack3(k*(d_I[3] * S), b.d[3], lane0);
+			for (int i = 0; i < 3; i++) {
+				P d_S = load_pack3<V>(b.d_S[i], lane0);
+				store_pack3(k*(d_S * I + d_I[i] * S), b.d[i], lane0);
+			}
+		}
+
+	}
+}
@@ -0,0 +1,81 @@
+#include"surface_mesh_topology.h"
+#include"surface_mesh.h"
+
+using namespace MS;
+
+void half_edge_topology::build(std::vector<vertex*>& vertices) {
+	num_vertices = vertices.size();
+
+	offset.resize(num_vertices + 1);
+	offset[0] = 0;
+	for (int i = 0; i < num_vertices; i++) {
+		vertices[i]->index = i;
+		offset[i + 1] = offset[i] + vertices[i]->n.size();
+	}
+	num_half_edges = offset[num_vertices];
+
+	target.resize(num_half_edges);
+	next.resize(num_half_edges);
+	prev.resize(num_half_edges);
+	twin.resize(num_half_edges);
+
+	for (int i = 0; i < num_vertices; i++) {
+		vertex *v = vertices[i];
+		int o = offset[i];
+		int k = v->n.size();
+		for (int j = 0; j < k; j++) {
+			target[o + j] = v->n[j]->index;
+			next[o + j] = o + (j < k - 1 ? j + 1 : 0);
+			prev[o + j] = o + (j > 0 ? j - 1 : k - 1);
+		}
+	}
+
+	// Twins need all targets to be known
+	int num_unpaired = 0;
+	for (int i = 0; i < num_vertices; i++) {
+		vertex *v = vertices[i];
+		int o = offset[i];
+		int k = v->n.size();
+		for (int j = 0; j < k; j++) {
+			int t = v->n[j]->neighbor_index(v);
+			twin[o + j] = (t >= 0 ? offset[target[o + j]] + t : -1);
+			if (t < 0) num_unpaired++;
+		}
+	}
+	if (num_unpaired)
+		LOG(WARNING) << "Number of half-edges without twins: " << num_unpaired;
+
+	for (int i = 0; i < num_vertices; i++) {
+		vertex *v = vertices[i];
+		v->offset = offset[i];
+		v->he_next = next.data() + offset[i];
+		v->he_prev = prev.data() + offset[i];
+		v->he_twin = twin.data() + offset[i];
+	}
+}
+
+void half_edge_topology::build_incidence(std::vector<facet*>& facets) {
+	int num_facets = facets.size();
+
+	facet_offset.assign(num_vertices + 1, 0);
+	for (int i = 0; i < num_facets; i++) {
+		facets[i]->index = i;
+		for (int j = 0; j < 3; j++)
+			facet_offset[facets[i]->v[j]->index + 1]++;
+	}
+	for (int i = 0; i < num_vertices; i++) {
+		facet_offset[i + 1] += facet_offset[i];
+	}
+
+	// Filling in the order of facets, so that facets around a vertex are sorted by index
+	incident_facet.resize(facet_offset[num_vertices]);
+	incident_corner.resize(facet_offset[num_vertices]);
+	std::vector<int> filled(facet_offset.begin(), facet_offset.end() - 1);
+	for (int i = 0; i < num_facets; i++) {
+		for (int j = 0; j < 3; j++) {
+			int k = filled[facets[i]->v[j]->index]++;
+			incident_facet[k] = i;
+			incident_corner[k] = j;
+		}
+	}
+}
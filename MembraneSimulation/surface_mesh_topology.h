@@ -0,0 +1,49 @@
+#pragma once
+
+/**********************************************************
+
+Compressed half-edge topology of a surface mesh.
+
+**********************************************************/
+
+#include<vector>
+
+namespace MS {
+	class vertex;
+	class facet;
+
+	class half_edge_topology {
+		/**********************************************************************
+		Each (vertex, neighbor) pair is a half-edge. The half-edges of vertex v
+		are stored contiguously as [offset[v], offset[v+1]), in the same
+		(counter-clockwise) order as vertex::n, so that the half-edge
+		offset[v] + i points from v to v->n[i].
+
+		All indices here are global half-edge indices, and are computed once
+		after the neighbor lists are loaded, so that the inner loops never need
+		to search for a neighbor.
+		**********************************************************************/
+	public:
+		int num_vertices = 0;
+		int num_half_edges = 0;
+
+		std::vector<int> offset; // Size num_vertices + 1
+		std::vector<int> target; // Index of the vertex the half-edge points to
+		std::vector<int> next; // Half-edge from the same vertex to the next neighbor (nn)
+		std::vector<int> prev; // Half-edge from the same vertex to the previous neighbor (np)
+		std::vector<int> twin; // Half-edge in the opposite direction, or -1 if there is none
+
+		// Facets around each vertex, sorted by facet index.
+		// The incident facets of vertex v are [facet_offset[v], facet_offset[v+1]).
+		std::vector<int> facet_offset; // Size num_vertices + 1
+		std::vector<int> incident_facet; // Index of the facet
+		std::vector<int> incident_corner; // Index of the vertex in the facet (0, 1 or 2)
+
+		// Neighbor lists (including np and nn) must be complete before building.
+		// This function also assigns the index, offset and half-edge pointers of every vertex.
+		void build(std::vector<vertex*>& vertices);
+		// Must be used after build(). This function also assigns the index of every facet.
+		void build_incidence(std::vector<facet*>& facets);
+	};
+
+}
@@ -1,3 +1,5 @@
+#include<atomic>
+
 #include"test.h"
 #include"log.h"
 
@@ -60,7 +62,7 @@ std::vector<TestCase*>& test::get_test_cases() {
 	return *ptr;
 }
 
-void test::run_all_tests() {
+bool test::run_all_tests() {
 	int num_test_cases = 0, num_passed_test_cases = 0;
 	int N = get_test_cases().size();
 	for (int i = 0; i < N; i++) {
@@ -73,4 +75,20 @@ void test::run_all_tests() {
 	else {
 		LOG(TEST_ERROR) << num_test_cases - num_passed_test_cases << " test(s) out of " << num_test_cases << " failed.";
 	}
+	return num_test_cases == num_passed_test_cases;
+}
+
+
+std::atomic<bool> test::allocation_counting(false);
+std::atomic<long long> test::num_allocations(0);
+bool test::allocation_counter_linked = false;
+
+bool test::allocation_counting_available() {
+	return allocation_counter_linked;
+}
+void test::set_allocation_counting(bool on) {
+	allocation_counting.store(on);
+}
+long long test::get_num_allocations() {
+	return num_allocations.load();
 }
\ No newline at end of file
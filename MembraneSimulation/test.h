@@ -1,5 +1,6 @@
 #pragma once
 
+#include<atomic>
 #include<string>
 #include<vector>
 #include<map>
@@ -47,6 +48,19 @@ namespace test {
 
 	// Test cases registering
 	std::vector<TestCase*>& get_test_cases();
-	void run_all_tests();
+	bool run_all_tests(); // Returns whether all tests passed
+
+	// Counting of heap allocations through the global operator new on all threads.
+	// The replacement of operator new is in test_allocation.cpp, which is only linked into the
+	// program running the tests, so that the simulation itself uses the default allocator.
+	// Counting is off unless turned on by a test.
+	bool allocation_counting_available(); // Whether test_allocation.cpp is linked
+	void set_allocation_counting(bool on);
+	long long get_num_allocations(); // Number of allocations counted so far
+
+	// Used by test_allocation.cpp
+	extern std::atomic<bool> allocation_counting;
+	extern std::atomic<long long> num_allocations;
+	extern bool allocation_counter_linked;
 
 }
\ No newline at end of file
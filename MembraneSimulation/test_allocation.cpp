@@ -0,0 +1,39 @@
+/*
+	Counting replacement of the global allocation functions, used by
+	test::set_allocation_counting(). Only linked into the program running the
+	tests, so that the simulation does not pay for the counter.
+*/
+
+#include<cstdlib>
+#include<new>
+
+#include"test.h"
+
+namespace {
+	// Constant initialization of allocation_counter_linked happens before this.
+	const bool linked = (test::allocation_counter_linked = true);
+}
+
+// Replacing the global allocation functions, which the other forms forward to.
+void* operator new(std::size_t size) {
+	if (test::allocation_counting.load(std::memory_order_relaxed))
+		test::num_allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+void operator delete[](void *p, std::size_t) noexcept {
+	std::free(p);
+}
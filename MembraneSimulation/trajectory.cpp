@@ -0,0 +1,150 @@
+#include<algorithm>
+#include<cstring>
+
+#include"common.h"
+#include"trajectory.h"
+
+using namespace MS;
+
+bool trajectory_writer::open(const std::string &file_name, size_t num_values, int values_per_item, bool single_precision) {
+	close();
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "MSTRAJ\0\0", 8);
+	header.byte_order = 0x01020304;
+	header.version = 1;
+	header.header_size = sizeof(trajectory_header);
+	header.value_size = (single_precision ? sizeof(float) : sizeof(double));
+	header.num_values = num_values;
+	header.values_per_item = values_per_item;
+
+	labels.clear();
+	frame_values.clear();
+	if (single_precision) buffer.resize(num_values);
+
+	file_out.open(file_name, std::ios::binary | std::ios::trunc);
+	if (!file_out.is_open()) {
+		LOG(ERROR) << "Cannot open trajectory file " << file_name;
+		return false;
+	}
+	file_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	return true;
+}
+
+void trajectory_writer::write_frame(const double *values, long long label, double value) {
+	if (!file_out.is_open()) return;
+
+	size_t n = header.num_values;
+	if (header.value_size == sizeof(float)) {
+		for (size_t i = 0; i < n; i++) buffer[i] = (float)values[i];
+		file_out.write(reinterpret_cast<const char*>(buffer.data()), n * sizeof(float));
+	}
+	else {
+		file_out.write(reinterpret_cast<const char*>(values), n * sizeof(double));
+	}
+	labels.push_back(label);
+	frame_values.push_back(value);
+}
+
+void trajectory_writer::close() {
+	if (!file_out.is_open()) return;
+
+	header.num_frames = labels.size();
+	header.index_offset = header.header_size + header.num_frames * header.num_values * header.value_size;
+	for (size_t i = 0; i < labels.size(); i++) {
+		int64_t label = labels[i];
+		file_out.write(reinterpret_cast<const char*>(&label), sizeof(label));
+		file_out.write(reinterpret_cast<const char*>(&frame_values[i]), sizeof(double));
+	}
+	file_out.seekp(0);
+	file_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file_out.close();
+}
+
+bool async_trajectory_writer::open(const std::string &file_name, size_t n_num_values, int values_per_item, bool single_precision, int num_buffers, int n_every, bool n_drop_when_full) {
+	close();
+	if (!writer.open(file_name, n_num_values, values_per_item, single_precision)) return false;
+
+	num_values = n_num_values;
+	every = (n_every < 1 ? 1 : n_every);
+	drop_when_full = n_drop_when_full;
+	num_calls = 0;
+	num_dropped = 0;
+
+	// One more slot than the buffers, so that a full ring could be told from an empty one.
+	ring.resize((num_buffers < 1 ? 1 : num_buffers) + 1);
+	for (auto& each_frame : ring) each_frame.values.resize(num_values);
+	head = tail = 0;
+	stop = false;
+	worker = std::thread(&async_trajectory_writer::worker_main, this);
+	opened = true;
+	return true;
+}
+
+void async_trajectory_writer::write_frame(const double *values, long long label, double value) {
+	if (!opened) return;
+	if (num_calls++ % every) return;
+
+	size_t slot;
+	{
+		std::unique_lock<std::mutex> lk(m);
+		auto full = [this] { return (tail + 1) % ring.size() == head; };
+		if (full()) {
+			if (drop_when_full) {
+				num_dropped++;
+				return;
+			}
+			cv_free.wait(lk, [&] { return !full(); });
+		}
+		slot = tail;
+	}
+
+	// The slot is not visible to the writer thread until tail is increased.
+	frame& f = ring[slot];
+	std::copy(values, values + num_values, f.values.begin());
+	f.label = label;
+	f.value = value;
+
+	{
+		std::lock_guard<std::mutex> lk(m);
+		tail = (tail + 1) % ring.size();
+	}
+	cv.notify_one();
+}
+
+void async_trajectory_writer::worker_main() {
+	while (true) {
+		size_t slot;
+		{
+			std::unique_lock<std::mutex> lk(m);
+			cv.wait(lk, [this] { return stop || head != tail; });
+			if (head == tail) return; // Stopped, and nothing left to write
+			slot = head;
+		}
+
+		const frame& f = ring[slot];
+		writer.write_frame(f.values.data(), f.label, f.value);
+
+		{
+			std::lock_guard<std::mutex> lk(m);
+			head = (head + 1) % ring.size();
+		}
+		cv_free.notify_one();
+	}
+}
+
+void async_trajectory_writer::close() {
+	if (!worker.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lk(m);
+		stop = true;
+	}
+	cv.notify_one();
+	worker.join();
+	writer.close();
+	opened = false;
+
+	if (num_dropped)
+		LOG(WARNING) << "Number of trajectory frames dropped because the output buffers are full: " << num_dropped;
+}
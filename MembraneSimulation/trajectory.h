@@ -0,0 +1,136 @@
+#pragma once
+
+/**********************************************************
+
+Binary trajectory files.
+
+**********************************************************/
+
+#include<condition_variable>
+#include<cstdint>
+#include<fstream>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+
+namespace MS {
+
+	struct trajectory_header {
+		/**********************************************************************
+		Layout of a trajectory file (all numbers in native byte order):
+
+			header     64 bytes, this structure
+			frames     num_frames * frame_size bytes. Every frame holds
+			           num_values float64 or float32 values. A frame starts at
+			           header_size + i * frame_size.
+			index      num_frames * (int64 label, float64 value), starting at
+			           index_offset
+
+		Frames have a fixed stride, so a file could be mapped into memory as a
+		(num_frames, num_values) array. The label and the value in the index
+		are given by the writer of each frame, e.g. the iteration number and
+		the energy.
+
+		num_frames and index_offset are written when the file is closed. If
+		they are 0, the file was not closed properly, and the number of frames
+		could be deduced from the file size.
+		**********************************************************************/
+		char magic[8]; // "MSTRAJ\0\0"
+		uint32_t byte_order; // 0x01020304 written in native byte order
+		uint32_t version;
+		uint32_t header_size;
+		uint32_t value_size; // 8 for float64, 4 for float32
+		uint64_t num_values; // Number of values in a frame
+		uint32_t values_per_item; // e.g. 3 for the coordinates of vertices
+		uint32_t reserved;
+		uint64_t num_frames;
+		uint64_t index_offset;
+		uint64_t reserved2;
+	};
+	static_assert(sizeof(trajectory_header) == 64, "Trajectory header must be 64 bytes.");
+
+	class trajectory_writer {
+		/**********************************************************************
+		Writes fixed-size frames of doubles to a trajectory file, optionally
+		converting them to float32.
+		**********************************************************************/
+	public:
+		trajectory_writer() {}
+		~trajectory_writer() { close(); }
+		trajectory_writer(const trajectory_writer&) = delete;
+
+		// Returns false if the file could not be opened.
+		bool open(const std::string &file_name, size_t num_values, int values_per_item, bool single_precision);
+		inline bool is_open()const { return file_out.is_open(); }
+
+		// values must hold num_values doubles.
+		void write_frame(const double *values, long long label = 0, double value = 0);
+
+		// Writes the index and completes the header.
+		void close();
+
+	private:
+		std::ofstream file_out;
+		trajectory_header header;
+		std::vector<float> buffer; // For the conversion to float32
+		std::vector<long long> labels;
+		std::vector<double> frame_values;
+	};
+
+	class async_trajectory_writer {
+		/**********************************************************************
+		Writes frames to a trajectory file on a background thread.
+
+		write_frame() copies the frame into a ring of preallocated buffers and
+		returns at once. The writer thread takes the buffers in order and
+		writes them with a trajectory_writer. If all buffers are waiting to be
+		written, the caller waits until one is written, unless drop_when_full
+		is given to open(), in which case the frame is dropped and the number
+		of dropped frames is logged on close.
+
+		Only every every-th call of write_frame() is recorded, starting from
+		the first one.
+		**********************************************************************/
+	public:
+		async_trajectory_writer() {}
+		~async_trajectory_writer() { close(); }
+		async_trajectory_writer(const async_trajectory_writer&) = delete;
+
+		bool open(const std::string &file_name, size_t num_values, int values_per_item, bool single_precision, int num_buffers, int every, bool drop_when_full = false);
+		inline bool is_open()const { return opened; } // The writer itself belongs to the writer thread
+
+		void write_frame(const double *values, long long label = 0, double value = 0);
+
+		// Waits for all frames in the buffers to be written, and closes the file.
+		void close();
+
+	private:
+		struct frame {
+			std::vector<double> values;
+			long long label;
+			double value;
+		};
+
+		trajectory_writer writer;
+		bool opened = false;
+		bool drop_when_full = false;
+		size_t num_values = 0;
+		int every = 1;
+		long long num_calls = 0;
+		long long num_dropped = 0;
+
+		std::vector<frame> ring;
+		// Frames [head, tail) (modulo ring size) are waiting to be written. Only
+		// the caller increases tail, and only the writer thread increases head.
+		size_t head = 0, tail = 0;
+		bool stop = false;
+		std::mutex m;
+		std::condition_variable cv; // Signaled when a frame is added or on close
+		std::condition_variable cv_free; // Signaled when a buffer is written
+		std::thread worker;
+
+		void worker_main();
+	};
+
+}
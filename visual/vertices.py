@@ -1,3 +1,5 @@
+import os
+
 import numpy as np
 import matplotlib.pyplot as plt
 import matplotlib
@@ -6,17 +8,69 @@ from mpl_toolkits.mplot3d import Axes3D
 import topo
 
 
+class Trajectory(object):
+    """
+    Reader of the binary trajectory files (.SimTraj) written by trajectory_writer.
+
+    Frames are mapped with numpy.memmap, so only the frames accessed are read.
+    frames has the shape (numFrames, numValues // valuesPerItem, valuesPerItem).
+    labels and values are read from the frame index, and are None if the file
+    was not closed properly.
+    """
+    headerDtype = np.dtype([
+        ('magic', 'S8'),
+        ('byteOrder', '<u4'),
+        ('version', '<u4'),
+        ('headerSize', '<u4'),
+        ('valueSize', '<u4'),
+        ('numValues', '<u8'),
+        ('valuesPerItem', '<u4'),
+        ('reserved', '<u4'),
+        ('numFrames', '<u8'),
+        ('indexOffset', '<u8'),
+        ('reserved2', '<u8')
+    ])
+    indexDtype = np.dtype([('label', '<i8'), ('value', '<f8')])
+
+    def __init__(self, fileName):
+        header = np.fromfile(fileName, dtype=self.headerDtype, count=1)[0]
+        if header['magic'] != b'MSTRAJ' or header['byteOrder'] != 0x01020304:
+            raise ValueError("%s is not a trajectory file" % fileName)
+
+        self.numValues = int(header['numValues'])
+        self.valuesPerItem = int(header['valuesPerItem'])
+        valueDtype = np.dtype('<f8') if header['valueSize'] == 8 else np.dtype('<f4')
+        frameSize = self.numValues * valueDtype.itemsize
+
+        self.numFrames = int(header['numFrames'])
+        indexOffset = int(header['indexOffset'])
+        if indexOffset == 0:
+            # Not closed properly. Only complete frames are used.
+            self.numFrames = (os.path.getsize(fileName) - int(header['headerSize'])) // frameSize
+
+        self.frames = np.memmap(
+            fileName, dtype=valueDtype, mode='r',
+            offset=int(header['headerSize']),
+            shape=(self.numFrames, self.numValues // self.valuesPerItem, self.valuesPerItem)
+        )
+
+        if indexOffset == 0:
+            self.labels = self.values = None
+        else:
+            index = np.memmap(fileName, dtype=self.indexDtype, mode='r', offset=indexOffset, shape=(self.numFrames,))
+            self.labels = index['label']
+            self.values = index['value']
+
+
 class VertexLoader(object):
     def __init__(self, fileName):
         self.fileLocation = fileName
 
     def loadVertex(self):
-        rawData = np.loadtxt(self.fileLocation)
-        size = rawData.shape
+        trajectory = Trajectory(self.fileLocation)
 
-        (self.numSnapshots, self.numVertices) = \
-            (size[0] // 3, 1) if len(size) < 2 else (size[0], size[1] // 3)
-        self.data = rawData.reshape(self.numSnapshots, self.numVertices, 3)
+        (self.numSnapshots, self.numVertices) = trajectory.frames.shape[:2]
+        self.data = trajectory.frames
 
     def loadTopo(self):
         topoLoader = topo.MeshworkLoader(r"C:\Users\drels\OneDrive\Documents\Source\Repos\MembraneSimulation\MeshGeneration\neighbors.txt")
@@ -76,7 +130,7 @@ class Plottor(object):
         self.ax.plot_trisurf(tri, newToBePlotted[:, 0], alpha=0.3, linewidth=1, edgecolor='k')
 
 if __name__ == '__main__':
-    loader = VertexLoader(r'C:\Users\drels\OneDrive\Documents\Source\Repos\MembraneSimulation\MembraneSimulation\p_out.SimOut')
+    loader = VertexLoader(r'C:\Users\drels\OneDrive\Documents\Source\Repos\MembraneSimulation\MembraneSimulation\p_out.SimTraj')
     loader.loadAll()
 
     plottor = Plottor()